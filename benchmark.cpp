@@ -0,0 +1,164 @@
+#include "graph.h"
+#include "corridor_graph.h"
+#include "distance_matrix.h"
+
+#include <chrono>
+#include <random>
+#include <thread>
+
+// Builds a random side x side maze on one floor: a spanning tree plus some extra openings.
+void BuildMaze(graph &g, int32_t side, std::mt19937 &rng)
+{
+  std::vector<FloorWallMap> floors(1);
+  FloorWallMap &floor = floors[0];
+  floor.z = 0;
+  floor.origin_y = 0;
+  floor.origin_x = 0;
+  floor.height = side;
+  floor.width = side;
+  floor.cells.assign(side * side, kTileKnown | kWallNorth | kWallEast | kWallSouth | kWallWest);
+
+  std::vector<uint8_t> visited(side * side, 0);
+  std::vector<int32_t> stack = {0};
+  visited[0] = 1;
+  while (!stack.empty())
+  {
+    int32_t cell = stack.back();
+    int32_t y = cell / side, x = cell % side;
+    int32_t options[4], num_options = 0;
+    if (y + 1 < side && !visited[cell + side])
+      options[num_options++] = 0;
+    if (x + 1 < side && !visited[cell + 1])
+      options[num_options++] = 1;
+    if (y > 0 && !visited[cell - side])
+      options[num_options++] = 2;
+    if (x > 0 && !visited[cell - 1])
+      options[num_options++] = 3;
+    if (num_options == 0)
+    {
+      stack.pop_back();
+      continue;
+    }
+    int32_t direction = options[rng() % num_options];
+    int32_t next = direction == 0 ? cell + side : direction == 1 ? cell + 1 : direction == 2 ? cell - side : cell - 1;
+    const uint8_t walls[4] = {kWallNorth, kWallEast, kWallSouth, kWallWest};
+    floor.cells[cell] &= ~walls[direction];
+    floor.cells[next] &= ~walls[(direction + 2) % 4];
+    visited[next] = 1;
+    stack.push_back(next);
+  }
+  for (int32_t i = 0; i < side * side / 10; i++)
+  {
+    int32_t cell = rng() % (side * (side - 1));
+    floor.cells[cell] &= ~kWallNorth;
+    floor.cells[cell + side] &= ~kWallSouth;
+  }
+  g.BuildFromWallMaps(floors, {}, 1);
+}
+
+// A start, a goal and a heading.
+struct Query
+{
+  Tile start;
+  Tile goal;
+  int direction;
+};
+
+// Draws num_queries random queries between the tiles of a side x side maze.
+std::vector<Query> MakeQueries(int32_t side, int32_t num_queries, std::mt19937 &rng)
+{
+  std::vector<Query> queries;
+  for (int32_t i = 0; i < num_queries; i++)
+  {
+    Tile start = {(int32_t)(rng() % side), (int32_t)(rng() % side), 0};
+    Tile goal = {(int32_t)(rng() % side), (int32_t)(rng() % side), 0};
+    queries.push_back({start, goal, (int)(rng() % 4)});
+  }
+  return queries;
+}
+
+// Runs one search per query and prints the throughput.
+template <typename Search>
+void RunQueries(const char *name, const std::vector<Query> &queries, Search search)
+{
+  std::vector<Tile> path;
+  int len;
+  int64_t total = 0;
+  auto begin = std::chrono::steady_clock::now();
+  for (const Query &query : queries)
+  {
+    search(query, path, len);
+    total += len;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  std::cout << name << ": " << queries.size() << " ricerche - " << seconds * 1000 << " ms - "
+            << queries.size() / seconds << " ricerche/s - costo totale " << total << std::endl;
+}
+
+int main(int argc, char const *argv[])
+{
+  int32_t side = argc > 1 ? atoi(argv[1]) : 60;
+  std::mt19937 rng(42);
+  graph g;
+  BuildMaze(g, side, rng);
+  std::cout << "Vertici: " << g.NumVertices() << " - Angoli: " << g.NumEdges() << std::endl;
+
+  distance_matrix matrix(g);
+  int max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (int threads = 1; threads <= max_threads; threads *= 2)
+  {
+    auto begin = std::chrono::steady_clock::now();
+    matrix.Compute({}, threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::cout << "Threads: " << threads << " - " << seconds * 1000 << " ms - "
+              << matrix.Size() / seconds << " sorgenti/s" << std::endl;
+  }
+
+  // Point-to-point searches, so a PGO build also trains the A*, corridor and depth-first paths.
+  std::vector<Query> queries = MakeQueries(side, 200, rng);
+  g.SetPathCacheCapacity(0);
+  RunQueries("A*", queries, [&](const Query &query, std::vector<Tile> &path, int &len)
+             { g.FindPathAStar(query.start, query.goal, path, len, query.direction); });
+
+  AStarSearch search(g);
+  RunQueries("A* a passi", queries, [&](const Query &query, std::vector<Tile> &path, int &len)
+             {
+               g.GetHeuristicTable(query.goal);
+               search.Start(query.start, query.goal, query.direction);
+               while (search.Step(64) == SearchStatus::Running)
+               {
+               }
+               search.GetPath(path, len);
+             });
+
+  corridor_graph corridors(g);
+  RunQueries("Corridoi", queries, [&](const Query &query, std::vector<Tile> &path, int &len)
+             { corridors.FindPath(query.start, query.goal, path, len, query.direction); });
+
+  RunQueries("DFS", queries, [&](const Query &query, std::vector<Tile> &path, int &len)
+             { g.FindPathDFS(query.start, query.goal, path, len); });
+
+  // Repeated queries with the path cache, while edge weights change: the cache keeps the paths
+  // that do not traverse a changed edge.
+  std::vector<Query> repeated;
+  for (int32_t i = 0; i < 1000; i++)
+  {
+    repeated.push_back(queries[rng() % 16]);
+  }
+  g.SetPathCacheCapacity(16);
+  g.SetPathCacheFineGrained(true);
+  int32_t num_searches = 0;
+  RunQueries("A* con cache", repeated, [&](const Query &query, std::vector<Tile> &path, int &len)
+             {
+               if (++num_searches % 50 == 0)
+               {
+                 Tile tile = {(int32_t)(rng() % side), (int32_t)(rng() % side), 0};
+                 for (const Tile &neighbour : g.GetAdjacencyList(tile))
+                 {
+                   g.ChangeTileWeight(tile, neighbour, 1 + num_searches / 50 % 2);
+                 }
+               }
+               g.FindPathAStar(query.start, query.goal, path, len, query.direction);
+             });
+  return 0;
+}
@@ -0,0 +1,370 @@
+#include "corridor_graph.h"
+
+corridor_graph::corridor_graph(const graph &g) : graph_(g), built_version_(0), built_(false), num_pruned_(0) {}
+
+// The WalkCorridor function follows the chain of degree-2 vertices that starts at a junction
+// with the given first step, until it reaches a junction, and stores it as a corridor.
+void corridor_graph::WalkCorridor(int32_t junction, int32_t first_step, uint16_t first_weight)
+{
+  Corridor c;
+  c.from = junction;
+  c.begin = chain_.size();
+  c.reverse = -1;
+  c.pruned = false;
+  int32_t corridor_id = corridors_.size();
+
+  int32_t prev = junctions_[junction];
+  int32_t cur = first_step;
+  chain_.push_back(prev);
+  chain_weight_.push_back(first_weight);
+  while (junction_id_[cur] == -1)
+  {
+    if (vertex_corridor_[cur] == -1)
+    {
+      vertex_corridor_[cur] = corridor_id;
+      vertex_position_[cur] = chain_.size() - c.begin;
+    }
+    chain_.push_back(cur);
+    for (const EdgeView &edge : graph_.Neighbours(cur))
+    {
+      if (edge.vertex_index != prev)
+      {
+        prev = cur;
+        cur = edge.vertex_index;
+        chain_weight_.push_back(edge.weight);
+        break;
+      }
+    }
+  }
+  chain_.push_back(cur);
+  chain_weight_.push_back(0);
+  c.to = junction_id_[cur];
+  c.end = chain_.size();
+
+  for (int heading = 0; heading < 4; heading++)
+  {
+    int direction = heading;
+    c.cost[heading] = Traverse(c, 0, c.end - c.begin - 1, direction);
+    c.exit_direction[heading] = direction;
+  }
+  corridors_.push_back(c);
+}
+
+// The Traverse function returns the cost of walking a corridor between two positions,
+// and updates the heading like the A* expansion does, one step at a time.
+int32_t corridor_graph::Traverse(const Corridor &c, int32_t from_position, int32_t to_position, int &direction) const
+{
+  const CostPolicy &policy = graph_.GetCostPolicy();
+  int32_t cost = 0;
+  for (int32_t i = c.begin + from_position; i < c.begin + to_position; i++)
+  {
+    cost += policy.StepCost(graph_.GetTile(chain_[i]), direction, graph_.GetTile(chain_[i + 1]), chain_weight_[i], direction);
+  }
+  return cost;
+}
+
+void corridor_graph::Rebuild()
+{
+  int32_t num_vertices = graph_.NumVertexSlots();
+  junctions_.clear();
+  corridors_.clear();
+  corridors_begin_.clear();
+  chain_.clear();
+  chain_weight_.clear();
+  junction_id_.assign(num_vertices, -1);
+  vertex_corridor_.assign(num_vertices, -1);
+  vertex_position_.assign(num_vertices, -1);
+
+  for (int32_t i = 0; i < num_vertices; i++)
+  {
+    if (graph_.IsRemoved(i))
+      continue;
+    int degree = 0;
+    for (const EdgeView &edge : graph_.Neighbours(i))
+    {
+      (void)edge;
+      degree++;
+    }
+    if (degree != 2)
+    {
+      junction_id_[i] = junctions_.size();
+      junctions_.push_back(i);
+    }
+  }
+
+  // Corridors are stored grouped by their first junction. Components made only of
+  // degree-2 vertices are cycles without junctions: one of their vertices is promoted.
+  int32_t cycle_scan = 0;
+  for (int32_t j = 0;; j++)
+  {
+    if (j == (int32_t)junctions_.size())
+    {
+      while (cycle_scan < num_vertices && (junction_id_[cycle_scan] != -1 || vertex_corridor_[cycle_scan] != -1 || graph_.IsRemoved(cycle_scan)))
+        cycle_scan++;
+      if (cycle_scan == num_vertices)
+        break;
+      junction_id_[cycle_scan] = junctions_.size();
+      junctions_.push_back(cycle_scan);
+    }
+    corridors_begin_.push_back(corridors_.size());
+    for (const EdgeView &edge : graph_.Neighbours(junctions_[j]))
+    {
+      WalkCorridor(j, edge.vertex_index, edge.weight);
+    }
+  }
+  corridors_begin_.push_back(corridors_.size());
+
+  for (Corridor &c : corridors_)
+  {
+    int32_t last_step = chain_[c.end - 2];
+    for (int32_t r = corridors_begin_[c.to]; r < corridors_begin_[c.to + 1]; r++)
+    {
+      if (chain_[corridors_[r].begin + 1] == last_step)
+      {
+        c.reverse = r;
+        break;
+      }
+    }
+  }
+
+  // Prune dead-end trees: repeatedly peel junctions left with a single corridor,
+  // remembering the corridor that leads back towards the rest of the maze.
+  int32_t num_junctions = junctions_.size();
+  std::vector<int32_t> degree(num_junctions);
+  std::vector<int32_t> queue;
+  parent_corridor_.assign(num_junctions, -1);
+  for (int32_t j = 0; j < num_junctions; j++)
+  {
+    degree[j] = corridors_begin_[j + 1] - corridors_begin_[j];
+    if (degree[j] == 1)
+      queue.push_back(j);
+  }
+  num_pruned_ = 0;
+  for (size_t q = 0; q < queue.size(); q++)
+  {
+    int32_t j = queue[q];
+    if (degree[j] != 1)
+      continue;
+    for (int32_t c = corridors_begin_[j]; c < corridors_begin_[j + 1]; c++)
+    {
+      if (corridors_[c].pruned)
+        continue;
+      parent_corridor_[j] = c;
+      corridors_[corridors_[c].reverse].pruned = true;
+      num_pruned_++;
+      degree[j] = 0;
+      if (--degree[corridors_[c].to] == 1)
+        queue.push_back(corridors_[c].to);
+      break;
+    }
+  }
+
+  allowed_.assign(corridors_.size(), 0);
+  built_version_ = graph_.Version();
+  built_ = true;
+}
+
+// The AllowTowards function unlocks the pruned corridors on the way from the rest of the maze
+// down to the given junction, so that a goal inside a dead-end tree stays reachable.
+void corridor_graph::AllowTowards(int32_t junction, std::vector<int32_t> &allowed_list)
+{
+  while (parent_corridor_[junction] != -1)
+  {
+    const Corridor &c = corridors_[parent_corridor_[junction]];
+    if (allowed_[c.reverse])
+      return;
+    allowed_[c.reverse] = 1;
+    allowed_list.push_back(c.reverse);
+    junction = c.to;
+  }
+}
+
+void corridor_graph::FindPath(const Tile &start, const Tile &goal, std::vector<Tile> &path, int &len, int const direction)
+{
+  path.clear();
+  len = -1;
+  // States are indexed junction * 4 + heading, so any other heading would read another junction's state.
+  if (direction < 0 || direction > 3)
+    return;
+  if (start == goal)
+  {
+    path.push_back(start);
+    len = 0;
+    return;
+  }
+  int32_t index_start = graph_.GetNode(start);
+  int32_t index_goal = graph_.GetNode(goal);
+  if (index_start == -1 || index_goal == -1 || !graph_.AreConnected(start, goal))
+    return;
+  if (!built_ || built_version_ != graph_.Version())
+    Rebuild();
+
+  int32_t num_states = 4 * junctions_.size();
+  cost_.assign(num_states, INT32_MAX);
+  pred_state_.assign(num_states, -1);
+  pred_corridor_.assign(num_states, -1);
+  pred_position_.assign(num_states, 0);
+  open_states_.clear();
+  CompareOpenState compare;
+
+  // A goal inside a corridor is reached part way through it, from either side.
+  std::vector<int32_t> allowed_list;
+  int32_t goal_corridor = vertex_corridor_[index_goal];
+  int32_t goal_position = vertex_position_[index_goal];
+  if (goal_corridor == -1)
+  {
+    AllowTowards(junction_id_[index_goal], allowed_list);
+  }
+  else
+  {
+    AllowTowards(corridors_[goal_corridor].from, allowed_list);
+    AllowTowards(corridors_[goal_corridor].to, allowed_list);
+  }
+
+  int32_t best_cost = INT32_MAX;
+  int32_t best_pred_state = -1;
+  int32_t best_corridor = -1;
+  int32_t best_from_position = 0;
+  int32_t best_to_position = 0;
+
+  auto relax = [&](int32_t state, int32_t cost, int32_t pred_state, int32_t corridor, int32_t position)
+  {
+    if (cost < cost_[state])
+    {
+      cost_[state] = cost;
+      pred_state_[state] = pred_state;
+      pred_corridor_[state] = corridor;
+      pred_position_[state] = position;
+      open_states_.push_back({cost, state});
+      std::push_heap(open_states_.begin(), open_states_.end(), compare);
+    }
+  };
+  auto check_goal = [&](int32_t corridor, int32_t from_position, int heading, int32_t cost, int32_t pred_state)
+  {
+    if (goal_corridor == -1)
+      return;
+    const Corridor &c = corridors_[corridor];
+    int32_t to_position;
+    if (corridor == goal_corridor)
+      to_position = goal_position;
+    else if (corridor == corridors_[goal_corridor].reverse)
+      to_position = c.end - c.begin - 1 - goal_position;
+    else
+      return;
+    if (to_position <= from_position)
+      return;
+    int new_direction = heading;
+    int32_t goal_cost = cost + Traverse(c, from_position, to_position, new_direction);
+    if (goal_cost < best_cost)
+    {
+      best_cost = goal_cost;
+      best_pred_state = pred_state;
+      best_corridor = corridor;
+      best_from_position = from_position;
+      best_to_position = to_position;
+    }
+  };
+
+  int32_t start_corridor = vertex_corridor_[index_start];
+  if (start_corridor == -1)
+  {
+    relax(junction_id_[index_start] * 4 + direction, 0, -1, -1, 0);
+  }
+  else
+  {
+    int32_t forward_position = vertex_position_[index_start];
+    const Corridor &forward = corridors_[start_corridor];
+    int32_t reverse_corridor = forward.reverse;
+    int32_t corridor_len = forward.end - forward.begin;
+    int32_t seeds[2][2] = {{start_corridor, forward_position}, {reverse_corridor, corridor_len - 1 - forward_position}};
+    for (auto &seed : seeds)
+    {
+      const Corridor &c = corridors_[seed[0]];
+      check_goal(seed[0], seed[1], direction, 0, -1);
+      int new_direction = direction;
+      int32_t cost = Traverse(c, seed[1], corridor_len - 1, new_direction);
+      relax(c.to * 4 + new_direction, cost, -1, seed[0], seed[1]);
+    }
+  }
+
+  while (!open_states_.empty())
+  {
+    std::pop_heap(open_states_.begin(), open_states_.end(), compare);
+    OpenState cur = open_states_.back();
+    open_states_.pop_back();
+    if (cur.cost != cost_[cur.state])
+      continue;
+    if (cur.cost >= best_cost)
+      break;
+    int32_t junction = cur.state / 4;
+    int heading = cur.state % 4;
+    if (junctions_[junction] == index_goal)
+    {
+      best_cost = cur.cost;
+      best_pred_state = cur.state;
+      best_corridor = -1;
+      break;
+    }
+    for (int32_t c = corridors_begin_[junction]; c < corridors_begin_[junction + 1]; c++)
+    {
+      const Corridor &corridor = corridors_[c];
+      if (corridor.pruned && !allowed_[c])
+        continue;
+      check_goal(c, 0, heading, cur.cost, cur.state);
+      relax(corridor.to * 4 + corridor.exit_direction[heading], cur.cost + corridor.cost[heading], cur.state, c, 0);
+    }
+  }
+
+  for (int32_t c : allowed_list)
+  {
+    allowed_[c] = 0;
+  }
+  if (best_cost == INT32_MAX)
+    return;
+
+  // Collect the corridor segments from the goal back to the start, then expand them.
+  struct Segment
+  {
+    int32_t corridor, from_position, to_position;
+  };
+  std::vector<Segment> segments;
+  if (best_corridor != -1)
+    segments.push_back({best_corridor, best_from_position, best_to_position});
+  for (int32_t state = best_pred_state; state != -1 && pred_corridor_[state] != -1; state = pred_state_[state])
+  {
+    const Corridor &c = corridors_[pred_corridor_[state]];
+    segments.push_back({pred_corridor_[state], pred_position_[state], c.end - c.begin - 1});
+  }
+  std::reverse(segments.begin(), segments.end());
+  path.push_back(start);
+  for (const Segment &segment : segments)
+  {
+    const Corridor &c = corridors_[segment.corridor];
+    for (int32_t i = segment.from_position + 1; i <= segment.to_position; i++)
+    {
+      path.push_back(graph_.GetTile(chain_[c.begin + i]));
+    }
+  }
+  len = best_cost;
+}
+
+int32_t corridor_graph::NumJunctions()
+{
+  if (!built_ || built_version_ != graph_.Version())
+    Rebuild();
+  return junctions_.size();
+}
+
+int32_t corridor_graph::NumCorridors()
+{
+  if (!built_ || built_version_ != graph_.Version())
+    Rebuild();
+  return corridors_.size() / 2;
+}
+
+int32_t corridor_graph::NumPrunedCorridors()
+{
+  if (!built_ || built_version_ != graph_.Version())
+    Rebuild();
+  return num_pruned_;
+}
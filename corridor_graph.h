@@ -0,0 +1,116 @@
+/**
+ * @file corridor_graph.h
+ * @brief Definition of the corridor_graph class, a compressed view of a graph for faster path finding.
+ */
+
+#pragma once
+
+#include "graph.h"
+
+/**
+ * @class corridor_graph
+ * @brief Search layer that collapses corridors of a graph into single weighted edges.
+ *
+ * Vertices whose degree is not 2 become junctions; every chain of degree-2 vertices
+ * between two junctions becomes a corridor, whose traversal cost under the CostPolicy of the
+ * graph is precomputed for each of the four entry headings.
+ * Trees of dead ends hanging off the rest of the maze are pruned: the search never
+ * enters them unless they hold the goal. Paths are expanded back to full tile sequences.
+ *
+ * The layer is rebuilt lazily, in O(V + E), whenever the version of the graph changes.
+ */
+class corridor_graph
+{
+private:
+  /**
+   * @struct Corridor
+   * @brief Directed chain of vertices between two junctions.
+   */
+  struct Corridor
+  {
+    int32_t from;              ///< Junction id of the first vertex.
+    int32_t to;                ///< Junction id of the last vertex.
+    int32_t begin;             ///< Offset of the first vertex in chain_, endpoints included.
+    int32_t end;               ///< Offset past the last vertex in chain_.
+    int32_t reverse;           ///< Id of the same corridor walked the other way.
+    int32_t cost[4];           ///< Traversal cost for each entry heading.
+    int8_t exit_direction[4];  ///< Heading on the last vertex for each entry heading.
+    bool pruned;               ///< The corridor leads into a dead-end tree.
+  };
+
+  const graph &graph_;
+  uint64_t built_version_;
+  bool built_;
+
+  std::vector<int32_t> junctions_;             // Junction id to vertex index.
+  std::vector<int32_t> junction_id_;           // Vertex index to junction id, -1 for corridor vertices.
+  std::vector<int32_t> corridors_begin_;       // Corridors leaving junction j are [corridors_begin_[j], corridors_begin_[j + 1]).
+  std::vector<Corridor> corridors_;
+  std::vector<int32_t> chain_;                 // Vertex indices of all the corridors.
+  std::vector<uint16_t> chain_weight_;         // Weight of the step from chain_[i] to chain_[i + 1].
+  std::vector<int32_t> vertex_corridor_;       // Corridor holding a corridor vertex, -1 for junctions.
+  std::vector<int32_t> vertex_position_;       // Position of a corridor vertex inside vertex_corridor_.
+  std::vector<int32_t> parent_corridor_;       // For a pruned junction, the corridor towards the rest of the maze.
+  int32_t num_pruned_;
+
+  // Search workspace, indexed by junction id * 4 + heading.
+  struct OpenState
+  {
+    int32_t cost;
+    int32_t state;
+  };
+  struct CompareOpenState
+  {
+    bool operator()(const OpenState &a, const OpenState &b) const
+    {
+      return a.cost > b.cost;
+    }
+  };
+  std::vector<int32_t> cost_;
+  std::vector<int32_t> pred_state_;
+  std::vector<int32_t> pred_corridor_;
+  std::vector<int32_t> pred_position_;
+  std::vector<OpenState> open_states_;
+  std::vector<uint8_t> allowed_;
+
+  void Rebuild();
+  void WalkCorridor(int32_t junction, int32_t first_step, uint16_t first_weight);
+  int32_t Traverse(const Corridor &c, int32_t from_position, int32_t to_position, int &direction) const;
+  void AllowTowards(int32_t vertex, std::vector<int32_t> &allowed_list);
+
+public:
+  /**
+   * @brief Constructs the layer over a graph.
+   * @param g The graph to compress. It must outlive the layer.
+   */
+  corridor_graph(const graph &g);
+
+  /**
+   * @brief Finds the cheapest path between two tiles, with the cost model of graph::FindPathAStar.
+   * The search runs over (junction, heading) states, so the result is optimal for that cost model.
+   * @param start The tile associated with the start vertex.
+   * @param goal The tile associated with the goal vertex.
+   * @param path The vector to store the tiles of the found path.
+   * @param len The length of the found path, or -1 if no path was found or direction is not in 0..3.
+   * @param direction The direction the robot faces on the start tile.
+   */
+  void FindPath(const Tile &start, const Tile &goal, std::vector<Tile> &path, int &len, int const direction);
+
+  /**
+   * @brief Returns the number of junctions, rebuilding the layer if the graph changed.
+   * @return The number of junctions.
+   */
+  int32_t NumJunctions();
+
+  /**
+   * @brief Returns the number of corridors, rebuilding the layer if the graph changed.
+   * @return The number of (undirected) corridors.
+   */
+  int32_t NumCorridors();
+
+  /**
+   * @brief Returns the number of corridors leading into dead ends, rebuilding the layer if the graph changed.
+   * @return The number of pruned (undirected) corridors.
+   */
+  int32_t NumPrunedCorridors();
+};
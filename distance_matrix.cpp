@@ -0,0 +1,127 @@
+#include "distance_matrix.h"
+
+#include <atomic>
+#include <thread>
+
+distance_matrix::distance_matrix(const graph &g) : snapshot_(g) {}
+
+// The ComputeRow function runs Dijkstra from the tile of a row until every target vertex is settled.
+void distance_matrix::ComputeRow(int32_t row, const std::vector<uint8_t> &is_target, int32_t num_targets, std::vector<uint32_t> &dist, std::vector<uint64_t> &heap)
+{
+  uint32_t *out = &distances_[(size_t)row * tiles_.size()];
+  int32_t source = tile_vertices_[row];
+  if (source == -1)
+  {
+    std::fill(out, out + tiles_.size(), kUnreachable);
+    return;
+  }
+  dist.assign(snapshot_.NumVertexSlots(), kUnreachable);
+  int32_t settled_targets = 0;
+  ShortestDistances(
+      source, dist, heap,
+      [&](int32_t u, auto &relax)
+      {
+        for (int32_t e = snapshot_.EdgesBegin(u); e < snapshot_.EdgesEnd(u); e++)
+        {
+          relax(snapshot_.Target(e), snapshot_.Cost(e));
+        }
+      },
+      [&](int32_t u)
+      {
+        settled_targets += is_target[u];
+        return settled_targets < num_targets;
+      });
+  for (size_t column = 0; column < tiles_.size(); column++)
+  {
+    int32_t target = tile_vertices_[column];
+    out[column] = target == -1 ? kUnreachable : dist[target];
+  }
+}
+
+void distance_matrix::Compute(const std::vector<Tile> &tiles, int num_threads)
+{
+  int32_t n = snapshot_.NumVertexSlots();
+  tiles_.clear();
+  tile_vertices_.clear();
+  if (tiles.empty())
+  {
+    for (int32_t i = 0; i < n; i++)
+    {
+      if (!snapshot_.IsAlive(i))
+        continue;
+      tiles_.push_back(snapshot_.GetTile(i));
+      tile_vertices_.push_back(i);
+    }
+  }
+  else
+  {
+    tiles_ = tiles;
+    for (const Tile &tile : tiles)
+    {
+      tile_vertices_.push_back(snapshot_.GetNode(tile));
+    }
+  }
+
+  std::vector<uint8_t> is_target(n, 0);
+  int32_t num_targets = 0;
+  for (int32_t vertex : tile_vertices_)
+  {
+    if (vertex != -1 && !is_target[vertex])
+    {
+      is_target[vertex] = 1;
+      num_targets++;
+    }
+  }
+
+  int32_t rows = tiles_.size();
+  distances_.assign((size_t)rows * rows, kUnreachable);
+  if (num_threads <= 0)
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  num_threads = std::max(1, std::min(num_threads, rows));
+
+  std::atomic<int32_t> next_row(0);
+  auto worker = [&]()
+  {
+    std::vector<uint32_t> dist;
+    std::vector<uint64_t> heap;
+    for (int32_t row = next_row.fetch_add(1, std::memory_order_relaxed); row < rows; row = next_row.fetch_add(1, std::memory_order_relaxed))
+    {
+      ComputeRow(row, is_target, num_targets, dist, heap);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int t = 1; t < num_threads; t++)
+  {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : threads)
+  {
+    thread.join();
+  }
+}
+
+int32_t distance_matrix::Size() const
+{
+  return tiles_.size();
+}
+
+const std::vector<Tile> &distance_matrix::Tiles() const
+{
+  return tiles_;
+}
+
+uint32_t distance_matrix::GetDistance(int32_t row, int32_t column) const
+{
+  return distances_[(size_t)row * tiles_.size() + column];
+}
+
+const uint32_t *distance_matrix::Row(int32_t row) const
+{
+  return &distances_[(size_t)row * tiles_.size()];
+}
+
+uint64_t distance_matrix::SnapshotVersion() const
+{
+  return snapshot_.Version();
+}
@@ -0,0 +1,83 @@
+/**
+ * @file distance_matrix.h
+ * @brief Definition of the distance_matrix class, many-to-many shortest distances computed in parallel.
+ */
+
+#pragma once
+
+#include "graph_snapshot.h"
+
+/**
+ * @class distance_matrix
+ * @brief Shortest distances between every pair of a set of tiles.
+ *
+ * The constructor takes a graph_snapshot, so the matrix can be computed while the graph keeps changing. Compute runs one Dijkstra
+ * per source tile; the sources are handed out to the worker threads one at a time through
+ * a shared counter, so threads that finish early keep taking work.
+ *
+ * Distances are sums of CostPolicy::MoveCost, with the cost policy of the graph at snapshot time:
+ * turn costs depend on the heading and are not included, so a distance is a lower bound of the
+ * cost of the same trip found by the heading-aware searches.
+ */
+class distance_matrix
+{
+public:
+  static constexpr uint32_t kUnreachable = UINT32_MAX;
+
+private:
+  graph_snapshot snapshot_;
+
+  std::vector<Tile> tiles_;
+  std::vector<int32_t> tile_vertices_;
+  std::vector<uint32_t> distances_; // Row-major, one row per source tile.
+
+  void ComputeRow(int32_t row, const std::vector<uint8_t> &is_target, int32_t num_targets, std::vector<uint32_t> &dist, std::vector<uint64_t> &heap);
+
+public:
+  /**
+   * @brief Takes a snapshot of a graph and of the move costs of its cost policy.
+   * @param g The graph to snapshot. It is not referenced after the constructor returns.
+   */
+  distance_matrix(const graph &g);
+
+  /**
+   * @brief Computes the distances between every pair of tiles.
+   * @param tiles The tiles to use as both sources and targets. If empty, every vertex of the snapshot is used.
+   * Tiles missing from the snapshot get unreachable rows and columns.
+   * @param num_threads The number of worker threads, 0 for one per hardware thread.
+   */
+  void Compute(const std::vector<Tile> &tiles, int num_threads = 0);
+
+  /**
+   * @brief Returns the number of rows (and columns) of the matrix.
+   * @return The number of tiles of the last Compute call.
+   */
+  int32_t Size() const;
+
+  /**
+   * @brief Returns the tiles of the rows and columns, in order.
+   * @return The tiles of the last Compute call.
+   */
+  const std::vector<Tile> &Tiles() const;
+
+  /**
+   * @brief Returns the distance between the tiles of a row and a column.
+   * @param row The index of the source tile.
+   * @param column The index of the target tile.
+   * @return The distance, or kUnreachable if the target cannot be reached.
+   */
+  uint32_t GetDistance(int32_t row, int32_t column) const;
+
+  /**
+   * @brief Returns one row of the matrix.
+   * @param row The index of the source tile.
+   * @return A pointer to Size() distances.
+   */
+  const uint32_t *Row(int32_t row) const;
+
+  /**
+   * @brief Returns the version of the graph the snapshot was taken at.
+   * @return The graph version.
+   */
+  uint64_t SnapshotVersion() const;
+};
@@ -0,0 +1,432 @@
+/**
+ * @file fixed_graph.h
+ * @brief Definition of the fixed_graph class, an allocation-free variant of graph for embedded targets.
+ */
+
+#pragma once
+
+#include <array>
+
+#include "graph.h"
+
+/**
+ * @class fixed_graph
+ * @brief Graph with a compile-time capacity that never touches the heap.
+ *
+ * Vertices, half-edges, the tile lookup table and the A* workspace all live in
+ * fixed-size member arrays, so a fixed_graph declared as a global or static object
+ * uses only static storage. Edges are stored as index-linked half-edges taken from
+ * a pool with a free list, so removed edges are recycled.
+ *
+ * @tparam MaxVertices The maximum number of vertices.
+ * @tparam MaxEdges The maximum number of (undirected) edges.
+ */
+template <int32_t MaxVertices, int32_t MaxEdges>
+class fixed_graph
+{
+private:
+  static constexpr int32_t kMaxHalfEdges = 2 * MaxEdges;
+  static constexpr int32_t kMaxStates = 4 * MaxVertices;
+  static constexpr int32_t kMaxOpenNodes = 4 * kMaxHalfEdges + 1;
+
+  static constexpr int32_t TableSize(int32_t n)
+  {
+    int32_t size = 1;
+    while (size < 2 * n)
+      size <<= 1;
+    return size;
+  }
+  static constexpr int32_t kTableSize = TableSize(MaxVertices);
+
+  struct FixedHalfEdge
+  {
+    int32_t next_edge;
+    int32_t vertex_index;
+    uint16_t weight;
+  };
+
+  struct OpenNode
+  {
+    double distance;
+    int32_t state; // Vertex index * 4 + heading.
+  };
+
+  struct CompareOpenNode
+  {
+    bool operator()(const OpenNode &a, const OpenNode &b) const
+    {
+      return a.distance > b.distance;
+    }
+  };
+
+  std::array<Tile, MaxVertices> tiles_;
+  std::array<int32_t, MaxVertices> adjacency_list_;
+  int32_t num_vertices_;
+
+  std::array<FixedHalfEdge, kMaxHalfEdges> edges_;
+  int32_t num_edges_;
+  int32_t next_free_edge_;
+  int32_t free_list_;
+
+  // Open addressing table mapping a tile hash to its vertex index, -1 marks an empty slot.
+  std::array<int32_t, kTableSize> table_;
+
+  CostPolicy cost_policy_;
+
+  // A* workspace, indexed by state.
+  std::array<double, kMaxStates> dist_;
+  std::array<int32_t, kMaxStates> predecessor_;
+  std::array<bool, kMaxStates> closed_;
+  std::array<OpenNode, kMaxOpenNodes> open_nodes_;
+
+  static uint32_t Slot(const Tile &t)
+  {
+    return TileHasher{}(t) & (kTableSize - 1);
+  }
+
+  int32_t AllocHalfEdge()
+  {
+    if (free_list_ != -1)
+    {
+      int32_t e = free_list_;
+      free_list_ = edges_[e].next_edge;
+      return e;
+    }
+    if (next_free_edge_ < kMaxHalfEdges)
+      return next_free_edge_++;
+    return -1;
+  }
+
+  void AddHalfEdge(int32_t index_from, int32_t index_to, uint16_t weight, int32_t e)
+  {
+    edges_[e].weight = weight;
+    edges_[e].vertex_index = index_to;
+    edges_[e].next_edge = adjacency_list_[index_from];
+    adjacency_list_[index_from] = e;
+  }
+
+  int32_t FindHalfEdge(int32_t index_from, int32_t index_to) const
+  {
+    for (int32_t e = adjacency_list_[index_from]; e != -1; e = edges_[e].next_edge)
+    {
+      if (edges_[e].vertex_index == index_to)
+        return e;
+    }
+    return -1;
+  }
+
+  void RemoveHalfEdge(int32_t index_from, int32_t index_to)
+  {
+    int32_t *link = &adjacency_list_[index_from];
+    while (*link != -1)
+    {
+      int32_t e = *link;
+      if (edges_[e].vertex_index == index_to)
+      {
+        *link = edges_[e].next_edge;
+        edges_[e].next_edge = free_list_;
+        free_list_ = e;
+        return;
+      }
+      link = &edges_[e].next_edge;
+    }
+  }
+
+public:
+  /**
+   * @brief Capacity of a path: a lowest-cost path may pass a tile once per heading.
+   */
+  static constexpr int32_t kMaxPathSize = 4 * MaxVertices;
+
+  /**
+   * @brief Constructs an empty graph.
+   */
+  fixed_graph()
+  {
+    Clear();
+  }
+
+  /**
+   * @brief Removes all the vertices and edges from the graph.
+   */
+  void Clear()
+  {
+    num_vertices_ = 0;
+    num_edges_ = 0;
+    next_free_edge_ = 0;
+    free_list_ = -1;
+    table_.fill(-1);
+  }
+
+  /**
+   * @brief Returns the index of the given tile, or -1 if not found.
+   * @param t The tile associated with the vertex.
+   * @return The index of the tile, or -1 if not found.
+   */
+  int32_t GetNode(const Tile &t) const
+  {
+    if (!t.InKeyRange())
+      return -1;
+    for (uint32_t slot = Slot(t);; slot = (slot + 1) & (kTableSize - 1))
+    {
+      int32_t index = table_[slot];
+      if (index == -1)
+        return -1;
+      if (tiles_[index] == t)
+        return index;
+    }
+  }
+
+  /**
+   * @brief Adds a new vertex to the graph with the given tile.
+   * @param t The tile associated with the new vertex.
+   * @return True if the vertex is added, false if it already exists, is not Tile::InKeyRange() or the graph is full.
+   */
+  bool AddVertex(Tile t)
+  {
+    if (num_vertices_ == MaxVertices || !t.InKeyRange())
+      return false;
+    uint32_t slot = Slot(t);
+    while (table_[slot] != -1)
+    {
+      if (tiles_[table_[slot]] == t)
+        return false;
+      slot = (slot + 1) & (kTableSize - 1);
+    }
+    tiles_[num_vertices_] = t;
+    adjacency_list_[num_vertices_] = -1;
+    table_[slot] = num_vertices_;
+    num_vertices_++;
+    return true;
+  }
+
+  /**
+   * @brief Adds an edge between two vertices.
+   * @param from The tile associated with the source vertex.
+   * @param to The tile associated with the target vertex.
+   * @param weight The weight of the edge.
+   * @return True if the edge is added, false if a vertex is missing, the edge exists or the edge pool is full.
+   */
+  bool AddEdge(Tile from, Tile to, uint16_t weight)
+  {
+    if (from == to)
+      return false;
+    int32_t index_from = GetNode(from);
+    int32_t index_to = GetNode(to);
+    if (index_from == -1 || index_to == -1)
+      return false;
+    if (FindHalfEdge(index_from, index_to) != -1)
+      return false;
+    int32_t e1 = AllocHalfEdge();
+    int32_t e2 = AllocHalfEdge();
+    if (e1 == -1 || e2 == -1)
+    {
+      // Put back the half-edge taken when only one was available.
+      if (e1 != -1)
+      {
+        edges_[e1].next_edge = free_list_;
+        free_list_ = e1;
+      }
+      return false;
+    }
+    AddHalfEdge(index_from, index_to, weight, e1);
+    AddHalfEdge(index_to, index_from, weight, e2);
+    num_edges_++;
+    return true;
+  }
+
+  /**
+   * @brief Changes the weight of an existing edge.
+   * @param from The tile associated with the source vertex.
+   * @param to The tile associated with the target vertex.
+   * @param weight The new weight of the edge.
+   * @return True if the weight is changed, false if the edge does not exist.
+   */
+  bool ChangeTileWeight(Tile from, Tile to, uint16_t weight)
+  {
+    int32_t index_from = GetNode(from);
+    int32_t index_to = GetNode(to);
+    if (index_from == -1 || index_to == -1 || index_from == index_to)
+      return false;
+    int32_t e1 = FindHalfEdge(index_from, index_to);
+    if (e1 == -1)
+      return false;
+    edges_[e1].weight = weight;
+    edges_[FindHalfEdge(index_to, index_from)].weight = weight;
+    return true;
+  }
+
+  /**
+   * @brief Changes the weight of all the edges leaving a tile.
+   * @param tile The tile associated with the adjacency list.
+   * @param weight The new weight of the edges.
+   * @return True if the weight is changed, false if the tile is not found or has no edges.
+   */
+  bool ChangeTileAdjacencyListWeight(Tile tile, uint16_t weight)
+  {
+    int32_t index = GetNode(tile);
+    if (index == -1 || adjacency_list_[index] == -1)
+      return false;
+    for (int32_t e = adjacency_list_[index]; e != -1; e = edges_[e].next_edge)
+      edges_[e].weight = weight;
+    return true;
+  }
+
+  /**
+   * @brief Removes an edge between two vertices.
+   * @param from The tile associated with the source vertex.
+   * @param to The tile associated with the target vertex.
+   * @return True if the edge is removed, false if it does not exist.
+   */
+  bool RemoveEdge(Tile from, Tile to)
+  {
+    int32_t index_from = GetNode(from);
+    int32_t index_to = GetNode(to);
+    if (index_from == -1 || index_to == -1 || index_from == index_to)
+      return false;
+    if (FindHalfEdge(index_from, index_to) == -1)
+      return false;
+    RemoveHalfEdge(index_from, index_to);
+    RemoveHalfEdge(index_to, index_from);
+    num_edges_--;
+    return true;
+  }
+
+  /**
+   * @brief Returns the number of vertices in the graph.
+   * @return The number of vertices.
+   */
+  int NumVertices() const
+  {
+    return num_vertices_;
+  }
+
+  /**
+   * @brief Returns the number of edges in the graph.
+   * @return The number of edges.
+   */
+  int NumEdges() const
+  {
+    return num_edges_;
+  }
+
+  /**
+   * @brief Calculates the degree of a vertex.
+   * @param tile The tile associated with the vertex.
+   * @param degree The calculated degree, added to the passed value like graph::NodeDegree.
+   * @return True if the vertex exists, false otherwise.
+   */
+  bool NodeDegree(Tile tile, int &degree) const
+  {
+    int32_t index = GetNode(tile);
+    if (index == -1)
+      return false;
+    for (int32_t e = adjacency_list_[index]; e != -1; e = edges_[e].next_edge)
+      ++degree;
+    return true;
+  }
+
+  /**
+   * @brief Checks if two vertices are adjacent.
+   * @param tile1 The tile associated with the first vertex.
+   * @param tile2 The tile associated with the second vertex.
+   * @return True if the vertices are adjacent, false otherwise.
+   */
+  bool AreAdjacent(Tile tile1, Tile tile2) const
+  {
+    int32_t index_from = GetNode(tile1);
+    int32_t index_to = GetNode(tile2);
+    if (index_from == -1 || index_to == -1)
+      return false;
+    return FindHalfEdge(index_from, index_to) != -1;
+  }
+
+  /**
+   * @brief Sets the cost model of FindPathAStar.
+   * @param policy The new cost model.
+   */
+  void SetCostPolicy(const CostPolicy &policy)
+  {
+    cost_policy_ = policy;
+  }
+
+  /**
+   * @brief Returns the cost model of FindPathAStar.
+   * @return The current cost model.
+   */
+  const CostPolicy &GetCostPolicy() const
+  {
+    return cost_policy_;
+  }
+
+  /**
+   * @brief Finds a path between two vertices with the same cost model as graph::FindPathAStar.
+   * The search runs over (vertex, heading) states, so the cost is the lowest one, as for graph::FindPathReference.
+   * @param start The tile associated with the start vertex.
+   * @param goal The tile associated with the goal vertex.
+   * @param path The array to store the tiles of the found path.
+   * @param path_size The number of tiles stored in path, 0 if no path was found.
+   * @param len The length of the found path, or -1 if no path was found.
+   * @param direction The direction the robot faces on the start tile, 0 to 3; any other value finds no path.
+   */
+  void FindPathAStar(const Tile &start, const Tile &goal, std::array<Tile, kMaxPathSize> &path, int32_t &path_size, int &len, int const direction)
+  {
+    path_size = 0;
+    len = -1;
+    int32_t index_start = GetNode(start);
+    int32_t index_goal = GetNode(goal);
+    if (index_start == -1 || index_goal == -1 || direction < 0 || direction > 3)
+      return;
+
+    for (int32_t i = 0; i < 4 * num_vertices_; i++)
+    {
+      dist_[i] = -1;
+      closed_[i] = false;
+    }
+    const CostPolicy policy = cost_policy_;
+    CompareOpenNode compare;
+    int32_t num_open = 0;
+    int32_t state_start = index_start * 4 + direction;
+    open_nodes_[num_open++] = {0.0, state_start};
+    dist_[state_start] = 0.0;
+    predecessor_[state_start] = -1;
+
+    while (num_open > 0)
+    {
+      std::pop_heap(open_nodes_.begin(), open_nodes_.begin() + num_open, compare);
+      int32_t state = open_nodes_[--num_open].state;
+      if (closed_[state])
+        continue;
+
+      int32_t vertex_index = state / 4;
+      if (vertex_index == index_goal)
+      {
+        for (int32_t current = state; current != -1; current = predecessor_[current])
+          path[path_size++] = tiles_[current / 4];
+        std::reverse(path.begin(), path.begin() + path_size);
+        len = dist_[state];
+        return;
+      }
+
+      closed_[state] = true;
+
+      for (int32_t e = adjacency_list_[vertex_index]; e != -1; e = edges_[e].next_edge)
+      {
+        int32_t neighbor = edges_[e].vertex_index;
+        int new_direction;
+        double new_dist = dist_[state] + policy.StepCost(tiles_[vertex_index], state % 4, tiles_[neighbor], edges_[e].weight, new_direction);
+        int32_t next = neighbor * 4 + new_direction;
+        if (closed_[next])
+          continue;
+        if (dist_[next] < 0 || new_dist < dist_[next])
+        {
+          dist_[next] = new_dist;
+          predecessor_[next] = state;
+          // Each state is expanded once, so every half-edge pushes at most once per heading and kMaxOpenNodes is never exceeded.
+          open_nodes_[num_open++] = {new_dist, next};
+          std::push_heap(open_nodes_.begin(), open_nodes_.begin() + num_open, compare);
+        }
+      }
+    }
+  }
+};
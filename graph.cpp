@@ -1,167 +1,170 @@
 #include "graph.h"
+#include "graph_snapshot.h"
 
 std::ostream &operator<<(std::ostream &os, const Tile &t)
 {
   return (os << "y: " << t.y << " - x: " << t.x << " - z: " << t.z);
 }
 
+// The prompts are user interface, not log messages: they go to the stream tied to the input.
 std::istream &operator>>(std::istream &is, Tile &t)
 {
-  LOG("Inserisci y:");
+  std::ostream *prompt = is.tie();
+  if (prompt != nullptr)
+    *prompt << "Inserisci y:" << std::endl;
   is >> t.y;
-  LOG("Inserisci x:");
+  if (prompt != nullptr)
+    *prompt << "Inserisci x:" << std::endl;
   is >> t.x;
-  LOG("Inserisci z:");
+  if (prompt != nullptr)
+    *prompt << "Inserisci z:" << std::endl;
   is >> t.z;
   return is;
 }
 
-bool operator==(const Tile &a, const Tile &b)
+//--------------------
+Vertex::Vertex() : inline_edges(), degree(0) {}
+//--------------------
+graph::graph() : version_(0), num_removed_(0), num_components_(0), components_dirty_(false), cut_version_(0), cut_valid_(false),
+                 path_cache_capacity_(16), path_cache_tick_(0), path_cache_fine_grained_(false), heuristic_tick_(0),
+                 min_weight_(0), max_span_(1), edge_bounds_version_(0), edge_bounds_valid_(false), num_edges_(0), total_weight_(0)
 {
-  if (a.x == b.x && a.y == b.y && a.z == b.z)
-    return true;
-  return false;
+  graph_.reserve(1000);
+  tile_y_.reserve(1000);
+  tile_x_.reserve(1000);
+  tile_z_.reserve(1000);
+  index_.reserve(1000);
 }
+graph::~graph() {}
 
-bool operator<(const Tile &a, const Tile &b)
+// The GetNode function searches for a node (vertex) in the graph based on a given tile.
+// It looks the packed tile key up in the index and returns the index of the node if found, or -1 if not found.
+int32_t graph::GetNode(const Tile &t) const
 {
-  if (a.z == b.z)
-  {
-    if (a.y == b.y)
-    {
-      return a.x < b.x;
-    }
-    else
-    {
-      return a.y < b.y;
-    }
-  }
-  else 
-    return a.z < b.z;
+  if (!t.InKeyRange())
+    return -1;
+  auto it = index_.find(t.Key());
+  if (it == index_.end())
+    return -1;
+  return it->second;
 }
 
-bool operator>(const Tile &a, const Tile &b)
-{
-  if (a.z == b.z)
-  {
-    if (a.y == b.y)
-    {
-      return a.x > b.x;
-    }
-    else
-    {
-      return a.y > b.y;
-    }
-  }
-  else
-    return a.z > b.z;
-}
-//--------------------
-Vertex::Vertex(Tile t, HalfEdge *adjacency_list, bool visited)
+int32_t graph::GetNode(const VertexHandle &handle) const
 {
-  this->tile = t;
-  this->adjacency_list = adjacency_list;
+  if (handle.slot >= slot_index_.size() || slot_generation_[handle.slot] != handle.generation)
+    return -1;
+  return slot_index_[handle.slot];
 }
-Vertex::Vertex(Tile t)
-{
-  this->tile = t;
-}
-//--------------------
-graph::graph()
+
+VertexHandle graph::GetHandle(const Tile &tile) const
 {
-  graph_.reserve(1000);
+  int32_t index = GetNode(tile);
+  if (index == -1)
+    return VertexHandle();
+  uint32_t slot = index_slot_[index];
+  return {slot, slot_generation_[slot]};
 }
-graph::~graph() {}
 
-// The GetNode function searches for a node (vertex) in the graph based on a given tile.
-// It iterates over the graph and returns the index of the node if found, or -1 if not found.
-int32_t graph::GetNode(const Tile &t)
+// The FindHalfEdge function returns the position of the half-edge towards index_to in the edges of index_from, or -1.
+int32_t FindHalfEdge(int32_t index_from, int32_t index_to, const std::vector<Vertex> &graph_)
 {
-  for (int32_t i = 0; i < graph_.size(); i++)
+  const Vertex &vertex = graph_[index_from];
+  const HalfEdge *edges = vertex.Edges();
+  for (int32_t i = 0; i < vertex.degree; i++)
   {
-    if (graph_.at(i).tile == t)
+    if (edges[i].vertex_index == index_to)
       return i;
   }
   return -1;
 }
 
-// The IsVertexIn function is a helper function used by other functions to check if a vertex exists in the graph.
-// It also updates the index parameter if the vertex is found.
-bool IsVertexIn(Tile t, int32_t &index, const std::vector<Vertex> &graph_)
+// The AuxAreAdjacent function checks if two nodes (vertices) are adjacent in the graph by scanning the edges of the first one.
+bool AuxAreAdjacent(int32_t index_from, int32_t index_to, const std::vector<Vertex> &graph_)
 {
-  for (int32_t i = 0; i < graph_.size(); i++)
-  {
-    if (graph_.at(i).tile == t)
-    {
-      index = i;
-      return true;
-    }
-  }
-  return false;
+  return FindHalfEdge(index_from, index_to, graph_) != -1;
 }
 
-// The AuxAreAdjacent function checks if two nodes (vertices) are adjacent in the graph by examining their adjacency lists.
-bool AuxAreAdjacent(int32_t index_from, int32_t index_to, const std::vector<Vertex> &graph_)
+// The AddHalfEdge function appends a half-edge to the edges of the source node.
+// The edges move to the overflow vector when they no longer fit inline.
+void AddHalfEdge(int32_t index_from, int32_t index_to, uint16_t weight, std::vector<Vertex> &graph_)
 {
-  HalfEdge *aux = graph_.at(index_from).adjacency_list;
-  while (aux != NULL)
+  Vertex &vertex = graph_[index_from];
+  if (vertex.degree < Vertex::kInlineEdges)
+  {
+    vertex.inline_edges[vertex.degree] = {index_to, weight};
+  }
+  else
   {
-    if (aux->vertex_index == index_to)
-      return true;
-    aux = aux->next_edge;
+    if (vertex.degree == Vertex::kInlineEdges)
+      vertex.overflow.assign(vertex.inline_edges, vertex.inline_edges + Vertex::kInlineEdges);
+    vertex.overflow.push_back({index_to, weight});
   }
-  return false;
+  vertex.degree++;
 }
 
-// The AddHalfEdge function adds a half-edge between two nodes in the graph.
-// It creates a new HalfEdge object and adds it to the adjacency list of the source node.
-void AddHalfEdge(int32_t index_from, int32_t index_to, uint16_t weight, std::vector<Vertex> &graph_)
+// The ChangeHalfEdgeWeight function changes the weight of one half-edge and returns the previous weight.
+uint16_t ChangeHalfEdgeWeight(int32_t index_from, int32_t index_to, uint16_t weight, std::vector<Vertex> &graph_)
 {
-  HalfEdge *e = new HalfEdge;
-  e->weight = weight;
-  e->vertex_index = index_to;
-  e->next_edge = graph_.at(index_from).adjacency_list;
-  graph_.at(index_from).adjacency_list = e;
+  int32_t position = FindHalfEdge(index_from, index_to, graph_);
+  if (position == -1)
+    return weight;
+  HalfEdge &edge = graph_[index_from].Edges()[position];
+  uint16_t old_weight = edge.weight;
+  edge.weight = weight;
+  return old_weight;
 }
 
-void ChangeHalfEdgeWeight(int32_t index_from, int32_t index_to, uint16_t weight, std::vector<Vertex> &graph_)
+void ChangeAdjacencyListWeight(int32_t index_tile, uint16_t weight, std::vector<Vertex> &graph_)
 {
-  for (HalfEdge *edges = graph_.at(index_from).adjacency_list; edges != nullptr; edges = edges->next_edge)
+  Vertex &vertex = graph_[index_tile];
+  HalfEdge *edges = vertex.Edges();
+  for (int32_t i = 0; i < vertex.degree; i++)
   {
-    if (edges->vertex_index == index_to)
-    {
-      edges->weight = weight;
-      return;
-    }
+    edges[i].weight = weight;
   }
 }
 
-void ChangeAdjacencyListWeight(int32_t index_tile, uint16_t weight, std::vector<Vertex> &graph_)
+// The SetHalfEdgeWeight function changes the weight of one half-edge and records the change.
+// It returns false if the half-edge does not exist.
+bool SetHalfEdgeWeight(int32_t index_from, int32_t index_to, uint16_t weight, std::vector<Vertex> &graph_, ChangeSet &changes)
 {
-  for (HalfEdge *edges = graph_.at(index_tile).adjacency_list; edges != nullptr; edges = edges->next_edge)
+  int32_t position = FindHalfEdge(index_from, index_to, graph_);
+  if (position == -1)
+    return false;
+  HalfEdge &edge = graph_[index_from].Edges()[position];
+  if (edge.weight != weight)
   {
-    edges->weight = weight;
+    changes.edges.push_back({index_from, index_to, edge.weight, weight});
+    changes.vertices.push_back(index_from);
+    edge.weight = weight;
   }
+  return true;
 }
 
-// The RemoveHalfEdge function removes a half-edge between two nodes in the graph.
-// It searches for the specified edge and removes it from the adjacency list of the source node.
-void RemoveHalfEdge(int32_t index_from, int32_t index_to, std::vector<Vertex> &graph_)
+// The RemoveHalfEdge function removes a half-edge between two nodes in the graph and returns its weight.
+// The following edges are shifted down, so the order of the others is kept.
+uint16_t RemoveHalfEdge(int32_t index_from, int32_t index_to, std::vector<Vertex> &graph_)
 {
-  for (HalfEdge *edges = graph_.at(index_from).adjacency_list; edges != nullptr; edges = edges->next_edge)
+  int32_t position = FindHalfEdge(index_from, index_to, graph_);
+  if (position == -1)
+    return 0;
+  Vertex &vertex = graph_[index_from];
+  uint16_t weight = vertex.Edges()[position].weight;
+  if (vertex.degree > Vertex::kInlineEdges)
   {
-    if (edges->vertex_index == index_to)
-    {
-      edges = edges->next_edge;
-      graph_.at(index_from).adjacency_list = edges;
-      return;
-    }
-    if (edges->next_edge->vertex_index == index_to)
+    vertex.overflow.erase(vertex.overflow.begin() + position);
+    if (vertex.degree - 1 == Vertex::kInlineEdges)
     {
-      edges->next_edge = edges->next_edge->next_edge;
-      return;
+      std::copy(vertex.overflow.begin(), vertex.overflow.end(), vertex.inline_edges);
+      vertex.overflow.clear();
     }
   }
+  else
+  {
+    std::copy(vertex.inline_edges + position + 1, vertex.inline_edges + vertex.degree, vertex.inline_edges + position);
+  }
+  vertex.degree--;
+  return weight;
 }
 
 /*******************************************************************************************************/
@@ -170,25 +173,174 @@ void RemoveHalfEdge(int32_t index_from, int32_t index_to, std::vector<Vertex> &g
 
 bool graph::AddVertex(Tile t)
 {
-  if (GetNode(t) >= 0)
+  if (InsertVertex(t) == -1)
     return false;
-  Vertex n = Vertex(t, nullptr, false);
-  graph_.push_back(n);
+  version_++;
+  RevalidatePathCache({}, false);
   return true;
 }
 
+// The InsertVertex function appends a vertex and indexes it.
+// It returns the index of the new vertex, or -1 if the tile is already in the graph or outside the key range.
+int32_t graph::InsertVertex(const Tile &t)
+{
+  int32_t index = graph_.size();
+  if (!t.InKeyRange() || !index_.emplace(t.Key(), index).second)
+    return -1;
+  graph_.push_back(Vertex());
+  tile_y_.push_back(t.y);
+  tile_x_.push_back(t.x);
+  tile_z_.push_back(t.z);
+  AddToSpatialIndex(index);
+  component_parent_.push_back(index);
+  component_size_.push_back(1);
+  num_components_++;
+  MoveDegree(-1, 0);
+  alive_.push_back(1);
+  uint32_t slot;
+  if (free_slots_.empty())
+  {
+    slot = slot_index_.size();
+    slot_index_.push_back(index);
+    slot_generation_.push_back(0);
+  }
+  else
+  {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+    slot_index_[slot] = index;
+  }
+  index_slot_.push_back(slot);
+  return index;
+}
+
+void graph::Clear()
+{
+  graph_.clear();
+  tile_y_.clear();
+  tile_x_.clear();
+  tile_z_.clear();
+  index_.clear();
+  floors_.clear();
+  cells_.clear();
+  component_parent_.clear();
+  component_size_.clear();
+  num_components_ = 0;
+  components_dirty_ = false;
+  ClearPathCache();
+  num_edges_ = 0;
+  total_weight_ = 0;
+  degree_histogram_.clear();
+  alive_.clear();
+  num_removed_ = 0;
+  index_slot_.clear();
+  for (uint32_t slot = 0; slot < slot_index_.size(); slot++)
+  {
+    if (slot_index_[slot] == -1)
+      continue;
+    slot_index_[slot] = -1;
+    slot_generation_[slot]++;
+    free_slots_.push_back(slot);
+  }
+  version_++;
+}
+
+int graph::Build(const std::vector<Tile> &tiles, const std::vector<TileEdge> &edges)
+{
+  Clear();
+  graph_.reserve(tiles.size());
+  tile_y_.reserve(tiles.size());
+  tile_x_.reserve(tiles.size());
+  tile_z_.reserve(tiles.size());
+  index_.reserve(tiles.size());
+  for (const Tile &tile : tiles)
+  {
+    InsertVertex(tile);
+  }
+
+  // Each undirected edge is identified by its (low, high) vertex indices packed in 64 bits.
+  std::unordered_set<uint64_t, TileKeyHasher> seen;
+  seen.reserve(edges.size());
+  int added = 0;
+  for (const TileEdge &edge : edges)
+  {
+    int32_t index_from = GetNode(edge.from);
+    int32_t index_to = GetNode(edge.to);
+    if (index_from == -1 || index_to == -1 || index_from == index_to)
+      continue;
+    uint64_t id = (uint64_t)std::min(index_from, index_to) << 32 | (uint32_t)std::max(index_from, index_to);
+    if (!seen.insert(id).second)
+      continue;
+    AddHalfEdge(index_from, index_to, edge.weight, graph_);
+    AddHalfEdge(index_to, index_from, edge.weight, graph_);
+    UniteComponents(index_from, index_to);
+    total_weight_ += 2 * edge.weight;
+    added++;
+  }
+  num_edges_ = added;
+  degree_histogram_.clear();
+  for (const Vertex &vertex : graph_)
+  {
+    MoveDegree(-1, vertex.degree);
+  }
+  version_++;
+  return added;
+}
+
+int graph::BuildFromWallMaps(const std::vector<FloorWallMap> &floors, const std::vector<TileEdge> &ramps, uint16_t weight)
+{
+  std::vector<Tile> tiles;
+  std::vector<TileEdge> edges;
+  for (const FloorWallMap &floor : floors)
+  {
+    for (int32_t row = 0; row < floor.height; row++)
+    {
+      for (int32_t column = 0; column < floor.width; column++)
+      {
+        uint8_t cell = floor.cells[row * floor.width + column];
+        if (!(cell & kTileKnown))
+          continue;
+        Tile tile = {floor.origin_y + row, floor.origin_x + column, floor.z};
+        tiles.push_back(tile);
+        if (column + 1 < floor.width)
+        {
+          uint8_t east = floor.cells[row * floor.width + column + 1];
+          if ((east & kTileKnown) && !(cell & kWallEast) && !(east & kWallWest))
+            edges.push_back({tile, {tile.y, tile.x + 1, tile.z}, weight});
+        }
+        if (row + 1 < floor.height)
+        {
+          uint8_t north = floor.cells[(row + 1) * floor.width + column];
+          if ((north & kTileKnown) && !(cell & kWallNorth) && !(north & kWallSouth))
+            edges.push_back({tile, {tile.y + 1, tile.x, tile.z}, weight});
+        }
+      }
+    }
+  }
+  edges.insert(edges.end(), ramps.begin(), ramps.end());
+  return Build(tiles, edges);
+}
+
 bool graph::AddEdge(Tile from, Tile to, uint16_t weight)
 {
   if (from == to)
     return false;
-  int32_t index_from;
-  int32_t index_to;
-  if (!IsVertexIn(from, index_from, graph_) || !IsVertexIn(to, index_to, graph_))
+  int32_t index_from = GetNode(from);
+  int32_t index_to = GetNode(to);
+  if (index_from == -1 || index_to == -1)
     return false;
   if (AuxAreAdjacent(index_from, index_to, graph_))
     return false;
   AddHalfEdge(index_from, index_to, weight, graph_);
   AddHalfEdge(index_to, index_from, weight, graph_);
+  MoveDegree(graph_[index_from].degree - 1, graph_[index_from].degree);
+  MoveDegree(graph_[index_to].degree - 1, graph_[index_to].degree);
+  num_edges_++;
+  total_weight_ += 2 * weight;
+  if (!components_dirty_)
+    UniteComponents(index_from, index_to);
+  version_++;
+  RevalidatePathCache(index_from, index_to, true);
   return true;
 }
 
@@ -196,14 +348,21 @@ bool graph::ChangeTileWeight(Tile from, Tile to, uint16_t weight)
 {
   if (from == to)
     return false;
-  int32_t index_from;
-  int32_t index_to;
-  if (!IsVertexIn(from, index_from, graph_) || !IsVertexIn(to, index_to, graph_))
+  int32_t index_from = GetNode(from);
+  int32_t index_to = GetNode(to);
+  if (index_from == -1 || index_to == -1)
     return false;
   if (!AuxAreAdjacent(index_from, index_to, graph_))
     return false;
-  ChangeHalfEdgeWeight(index_from, index_to, weight, graph_);
-  ChangeHalfEdgeWeight(index_to, index_from, weight, graph_);
+  uint16_t old_weight = ChangeHalfEdgeWeight(index_from, index_to, weight, graph_);
+  uint16_t old_reverse_weight = ChangeHalfEdgeWeight(index_to, index_from, weight, graph_);
+  total_weight_ += 2 * weight;
+  total_weight_ -= old_weight + old_reverse_weight;
+  version_++;
+  if (weight == old_weight && weight == old_reverse_weight)
+    RevalidatePathCache({}, false);
+  else
+    RevalidatePathCache(index_from, index_to, weight < old_weight || weight < old_reverse_weight);
   return true;
 }
 
@@ -211,9 +370,23 @@ bool graph::ChangeTileAdjacencyListWeight(Tile tile, uint16_t weight)
 {
   if (GetNode(tile) == -1)
     return false;
-  if (graph_.at(GetNode(tile)).adjacency_list == nullptr)
+  if (graph_.at(GetNode(tile)).degree == 0)
     return false;
-  ChangeAdjacencyListWeight(GetNode(tile), weight, graph_);
+  int32_t index_tile = GetNode(tile);
+  std::vector<uint64_t> costlier_edges;
+  bool cheaper = false;
+  for (const EdgeView &edge : Neighbours(index_tile))
+  {
+    total_weight_ += weight;
+    total_weight_ -= edge.weight;
+    if (weight < edge.weight)
+      cheaper = true;
+    else if (weight > edge.weight)
+      costlier_edges.push_back((uint64_t)std::min(index_tile, edge.vertex_index) << 32 | (uint32_t)std::max(index_tile, edge.vertex_index));
+  }
+  ChangeAdjacencyListWeight(index_tile, weight, graph_);
+  version_++;
+  RevalidatePathCache(costlier_edges, cheaper);
   return true;
 }
 
@@ -221,14 +394,20 @@ bool graph::RemoveEdge(Tile from, Tile to)
 {
   if (from == to)
     return false;
-  int32_t index_from;
-  int32_t index_to;
-  if (!IsVertexIn(from, index_from, graph_) || !IsVertexIn(to, index_to, graph_))
+  int32_t index_from = GetNode(from);
+  int32_t index_to = GetNode(to);
+  if (index_from == -1 || index_to == -1)
     return false;
   if (!AuxAreAdjacent(index_from, index_to, graph_))
     return false;
-  RemoveHalfEdge(index_from, index_to, graph_);
-  RemoveHalfEdge(index_to, index_from, graph_);
+  total_weight_ -= RemoveHalfEdge(index_from, index_to, graph_);
+  total_weight_ -= RemoveHalfEdge(index_to, index_from, graph_);
+  MoveDegree(graph_[index_from].degree + 1, graph_[index_from].degree);
+  MoveDegree(graph_[index_to].degree + 1, graph_[index_to].degree);
+  num_edges_--;
+  components_dirty_ = true;
+  version_++;
+  RevalidatePathCache(index_from, index_to, false);
   return true;
 }
 
@@ -237,65 +416,911 @@ bool graph::RemoveTileAdjacencyList(Tile tile)
   int32_t index_tile = GetNode(tile);
   if (index_tile == -1)
     return false;
-  if (graph_.at(index_tile).adjacency_list == nullptr)
+  if (graph_.at(index_tile).degree == 0)
     return false;
-  HalfEdge *edges = graph_.at(index_tile).adjacency_list;
-  while (edges != nullptr)
+  while (graph_[index_tile].degree > 0)
   {
-    RemoveEdge(graph_.at(edges->vertex_index).tile, graph_.at(index_tile).tile);
-    edges = edges->next_edge;
+    const Vertex &vertex = graph_[index_tile];
+    RemoveEdge(GetTile(vertex.Edges()[vertex.degree - 1].vertex_index), GetTile(index_tile));
   }
   return true;
 }
 
-int graph::NumVertices()
+bool graph::RemoveVertex(const Tile &tile)
 {
-  return graph_.size();
+  int32_t index = GetNode(tile);
+  if (index == -1)
+    return false;
+  RemoveTileAdjacencyList(tile);
+  index_.erase(tile.Key());
+  RemoveFromSpatialIndex(index);
+  MoveDegree(0, -1);
+  alive_[index] = 0;
+  num_removed_++;
+  uint32_t slot = index_slot_[index];
+  slot_index_[slot] = -1;
+  slot_generation_[slot]++;
+  free_slots_.push_back(slot);
+  components_dirty_ = true;
+  version_++;
+  RevalidatePathCache({}, false);
+  return true;
 }
 
-int graph::NumEdges()
+// The Compact function moves every live vertex down to its new index and rewrites the
+// edge targets on the way, then rebuilds the indices keyed by vertex index.
+int32_t graph::Compact()
 {
-  int tot = 0;
-  for (int32_t i = 0; i < graph_.size(); i++)
+  if (num_removed_ == 0)
+    return 0;
+  int32_t n = graph_.size();
+  std::vector<int32_t> new_index(n, -1);
+  int32_t kept = 0;
+  for (int32_t i = 0; i < n; i++)
+  {
+    if (alive_[i])
+      new_index[i] = kept++;
+  }
+  for (int32_t i = 0; i < n; i++)
+  {
+    if (!alive_[i])
+      continue;
+    int32_t k = new_index[i];
+    HalfEdge *edges = graph_[i].Edges();
+    for (int32_t e = 0; e < graph_[i].degree; e++)
+    {
+      edges[e].vertex_index = new_index[edges[e].vertex_index];
+    }
+    if (k == i)
+      continue;
+    graph_[k] = std::move(graph_[i]);
+    tile_y_[k] = tile_y_[i];
+    tile_x_[k] = tile_x_[i];
+    tile_z_[k] = tile_z_[i];
+    index_slot_[k] = index_slot_[i];
+  }
+  graph_.resize(kept);
+  graph_.shrink_to_fit();
+  tile_y_.resize(kept);
+  tile_y_.shrink_to_fit();
+  tile_x_.resize(kept);
+  tile_x_.shrink_to_fit();
+  tile_z_.resize(kept);
+  tile_z_.shrink_to_fit();
+  index_slot_.resize(kept);
+  index_slot_.shrink_to_fit();
+  for (int32_t &index : slot_index_)
+  {
+    if (index != -1)
+      index = new_index[index];
+  }
+  for (auto &entry : index_)
+  {
+    entry.second = new_index[entry.second];
+  }
+
+  floors_.clear();
+  cells_.clear();
+  for (int32_t i = 0; i < kept; i++)
+  {
+    AddToSpatialIndex(i);
+  }
+  component_parent_.resize(kept);
+  component_parent_.shrink_to_fit();
+  component_size_.resize(kept);
+  component_size_.shrink_to_fit();
+  components_dirty_ = true;
+  alive_.assign(kept, 1);
+  alive_.shrink_to_fit();
+  int32_t removed = num_removed_;
+  num_removed_ = 0;
+  ClearPathCache();
+  version_++;
+  return removed;
+}
+
+int32_t graph::NumRemovedVertices() const
+{
+  return num_removed_;
+}
+
+bool graph::IsRemoved(int32_t index) const
+{
+  return !alive_[index];
+}
+
+//--------------------
+
+int32_t graph::FindComponent(int32_t index) const
+{
+  while (component_parent_[index] != index)
+  {
+    component_parent_[index] = component_parent_[component_parent_[index]];
+    index = component_parent_[index];
+  }
+  return index;
+}
+
+void graph::UniteComponents(int32_t index1, int32_t index2) const
+{
+  int32_t root1 = FindComponent(index1);
+  int32_t root2 = FindComponent(index2);
+  if (root1 == root2)
+    return;
+  if (component_size_[root1] < component_size_[root2])
+    std::swap(root1, root2);
+  component_parent_[root2] = root1;
+  component_size_[root1] += component_size_[root2];
+  num_components_--;
+}
+
+void graph::RebuildComponents() const
+{
+  int32_t n = graph_.size();
+  for (int32_t i = 0; i < n; i++)
+  {
+    component_parent_[i] = i;
+    component_size_[i] = 1;
+  }
+  num_components_ = n - num_removed_;
+  for (int32_t i = 0; i < n; i++)
   {
-    NodeDegree(graph_.at(i).tile, tot);
+    for (const EdgeView &edge : Neighbours(i))
+    {
+      if (edge.vertex_index > i)
+        UniteComponents(i, edge.vertex_index);
+    }
   }
-  return (tot / 2);
+  components_dirty_ = false;
 }
 
-bool graph::NodeDegree(Tile t, int &degree)
+bool graph::AreConnected(const Tile &tile1, const Tile &tile2) const
 {
-  if (GetNode(t) < 0)
+  int32_t index1 = GetNode(tile1);
+  int32_t index2 = GetNode(tile2);
+  if (index1 == -1 || index2 == -1)
     return false;
-  Vertex vertex = graph_.at(GetNode(t));
-  for (HalfEdge *edges = vertex.adjacency_list; edges != nullptr; edges = edges->next_edge)
+  if (components_dirty_)
+    RebuildComponents();
+  return FindComponent(index1) == FindComponent(index2);
+}
+
+int32_t graph::NumComponents() const
+{
+  if (components_dirty_)
+    RebuildComponents();
+  return num_components_;
+}
+
+// The UpdateCutAnalysis function runs Tarjan's lowpoint algorithm with an explicit stack,
+// so deep corridors cannot overflow the call stack.
+void graph::UpdateCutAnalysis() const
+{
+  if (cut_valid_ && cut_version_ == version_)
+    return;
+  int32_t n = graph_.size();
+  std::vector<int32_t> discovery(n, -1);
+  std::vector<int32_t> low(n, 0);
+  std::vector<int32_t> parent(n, -1);
+  std::vector<int32_t> children(n, 0);
+  struct Frame
   {
-    ++degree;
+    int32_t vertex;
+    NeighbourRange::iterator next;
+  };
+  std::vector<Frame> stack;
+  cut_vertex_.assign(n, 0);
+  bridges_.clear();
+  int32_t time = 0;
+
+  for (int32_t root = 0; root < n; root++)
+  {
+    if (discovery[root] != -1)
+      continue;
+    discovery[root] = low[root] = time++;
+    stack.push_back({root, Neighbours(root).begin()});
+    while (!stack.empty())
+    {
+      Frame &frame = stack.back();
+      int32_t u = frame.vertex;
+      if (frame.next != Neighbours(u).end())
+      {
+        int32_t v = (*frame.next).vertex_index;
+        ++frame.next;
+        if (discovery[v] == -1)
+        {
+          parent[v] = u;
+          children[u]++;
+          discovery[v] = low[v] = time++;
+          stack.push_back({v, Neighbours(v).begin()});
+        }
+        else if (v != parent[u])
+        {
+          low[u] = std::min(low[u], discovery[v]);
+        }
+        continue;
+      }
+      stack.pop_back();
+      int32_t p = parent[u];
+      if (p == -1)
+      {
+        cut_vertex_[u] = children[u] > 1;
+        continue;
+      }
+      low[p] = std::min(low[p], low[u]);
+      if (parent[p] != -1 && low[u] >= discovery[p])
+        cut_vertex_[p] = 1;
+      if (low[u] > discovery[p])
+        bridges_.insert((uint64_t)std::min(u, p) << 32 | (uint32_t)std::max(u, p));
+    }
   }
+  cut_version_ = version_;
+  cut_valid_ = true;
+}
+
+bool graph::IsCutVertex(const Tile &tile) const
+{
+  int32_t index = GetNode(tile);
+  if (index == -1)
+    return false;
+  UpdateCutAnalysis();
+  return cut_vertex_[index];
+}
+
+bool graph::IsBridge(const Tile &tile1, const Tile &tile2) const
+{
+  int32_t index1 = GetNode(tile1);
+  int32_t index2 = GetNode(tile2);
+  if (index1 == -1 || index2 == -1)
+    return false;
+  UpdateCutAnalysis();
+  return bridges_.count((uint64_t)std::min(index1, index2) << 32 | (uint32_t)std::max(index1, index2)) > 0;
+}
+
+void graph::GetCutVertices(std::vector<Tile> &tiles) const
+{
+  UpdateCutAnalysis();
+  for (int32_t i = 0; i < (int32_t)cut_vertex_.size(); i++)
+  {
+    if (cut_vertex_[i])
+      tiles.push_back(GetTile(i));
+  }
+}
+
+void graph::GetBridges(std::vector<std::pair<Tile, Tile>> &bridges) const
+{
+  UpdateCutAnalysis();
+  for (uint64_t bridge : bridges_)
+  {
+    bridges.push_back({GetTile(bridge >> 32), GetTile((uint32_t)bridge)});
+  }
+}
+
+void ChangeSet::Clear()
+{
+  edges.clear();
+  vertices.clear();
+  added_vertices.clear();
+  added_edges.clear();
+  removed_edges.clear();
+  removed_vertices.clear();
+  version = 0;
+}
+
+void ChangeSet::Append(const ChangeSet &later)
+{
+  if (later.empty())
+    return;
+  // A stable sort keeps the batches in order within the run of each half-edge.
+  edges.insert(edges.end(), later.edges.begin(), later.edges.end());
+  std::stable_sort(edges.begin(), edges.end(), [](const EdgeChange &a, const EdgeChange &b)
+                   { return a.from != b.from ? a.from < b.from : a.to < b.to; });
+  size_t kept = 0;
+  for (size_t i = 0; i < edges.size();)
+  {
+    EdgeChange change = edges[i];
+    for (i++; i < edges.size() && edges[i].from == change.from && edges[i].to == change.to; i++)
+    {
+      change.new_weight = edges[i].new_weight;
+    }
+    if (change.new_weight != change.old_weight)
+      edges[kept++] = change;
+  }
+  edges.resize(kept);
+  vertices.insert(vertices.end(), later.vertices.begin(), later.vertices.end());
+  std::sort(vertices.begin(), vertices.end());
+  vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+  added_vertices.insert(added_vertices.end(), later.added_vertices.begin(), later.added_vertices.end());
+  added_edges.insert(added_edges.end(), later.added_edges.begin(), later.added_edges.end());
+  removed_edges.insert(removed_edges.end(), later.removed_edges.begin(), later.removed_edges.end());
+  removed_vertices.insert(removed_vertices.end(), later.removed_vertices.begin(), later.removed_vertices.end());
+  version = later.version;
+}
+
+// The FinishChangeSet function stamps a change set with the graph version,
+// bumping it once for the whole batch if anything changed.
+void graph::FinishChangeSet(ChangeSet &changes)
+{
+  if (!changes.empty())
+  {
+    version_++;
+    std::vector<uint64_t> costlier_edges;
+    bool cheaper = !changes.added_edges.empty();
+    for (const std::pair<int32_t, int32_t> &edge : changes.removed_edges)
+    {
+      costlier_edges.push_back((uint64_t)edge.first << 32 | (uint32_t)edge.second);
+    }
+    for (const EdgeChange &change : changes.edges)
+    {
+      total_weight_ += change.new_weight;
+      total_weight_ -= change.old_weight;
+      if (change.new_weight < change.old_weight)
+        cheaper = true;
+      else
+        costlier_edges.push_back((uint64_t)std::min(change.from, change.to) << 32 | (uint32_t)std::max(change.from, change.to));
+    }
+    RevalidatePathCache(costlier_edges, cheaper);
+  }
+  std::sort(changes.vertices.begin(), changes.vertices.end());
+  changes.vertices.erase(std::unique(changes.vertices.begin(), changes.vertices.end()), changes.vertices.end());
+  changes.version = version_;
+}
+
+int graph::ApplyEdgeWeights(const std::vector<EdgeWeightUpdate> &updates, ChangeSet &changes)
+{
+  changes.Clear();
+  // Resolve every update once, then keep only the last update of each edge.
+  struct ResolvedUpdate
+  {
+    int32_t low, high;
+    uint16_t weight;
+  };
+  std::vector<ResolvedUpdate> resolved;
+  resolved.reserve(updates.size());
+  for (const EdgeWeightUpdate &update : updates)
+  {
+    int32_t index_from = GetNode(update.from);
+    int32_t index_to = GetNode(update.to);
+    if (index_from == -1 || index_to == -1 || index_from == index_to)
+      continue;
+    resolved.push_back({std::min(index_from, index_to), std::max(index_from, index_to), update.weight});
+  }
+  std::stable_sort(resolved.begin(), resolved.end(), [](const ResolvedUpdate &a, const ResolvedUpdate &b)
+                   { return a.low != b.low ? a.low < b.low : a.high < b.high; });
+
+  int applied = 0;
+  for (size_t i = 0; i < resolved.size(); i++)
+  {
+    if (i + 1 < resolved.size() && resolved[i + 1].low == resolved[i].low && resolved[i + 1].high == resolved[i].high)
+      continue;
+    if (!SetHalfEdgeWeight(resolved[i].low, resolved[i].high, resolved[i].weight, graph_, changes))
+      continue;
+    SetHalfEdgeWeight(resolved[i].high, resolved[i].low, resolved[i].weight, graph_, changes);
+    applied++;
+  }
+  FinishChangeSet(changes);
+  return applied;
+}
+
+void graph::ApplyVertexWeights(const std::vector<int32_t> &indices, const TileWeightFunction &weight, ChangeSet &changes)
+{
+  for (int32_t index : indices)
+  {
+    Tile tile = GetTile(index);
+    HalfEdge *edges = graph_[index].Edges();
+    for (int32_t i = graph_[index].degree - 1; i >= 0; i--)
+    {
+      uint16_t new_weight = weight(tile, edges[i].weight);
+      if (new_weight != edges[i].weight)
+      {
+        changes.edges.push_back({index, edges[i].vertex_index, edges[i].weight, new_weight});
+        changes.vertices.push_back(index);
+        edges[i].weight = new_weight;
+      }
+    }
+  }
+  FinishChangeSet(changes);
+}
+
+int graph::ApplyTileWeights(const std::vector<Tile> &tiles, const TileWeightFunction &weight, ChangeSet &changes)
+{
+  changes.Clear();
+  std::vector<int32_t> indices;
+  indices.reserve(tiles.size());
+  for (const Tile &tile : tiles)
+  {
+    int32_t index = GetNode(tile);
+    if (index != -1)
+      indices.push_back(index);
+  }
+  std::sort(indices.begin(), indices.end());
+  indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+  ApplyVertexWeights(indices, weight, changes);
+  return indices.size();
+}
+
+int graph::ApplyRegionWeights(const Tile &min, const Tile &max, const TileWeightFunction &weight, ChangeSet &changes)
+{
+  changes.Clear();
+  std::vector<int32_t> indices;
+  GetVerticesInBox(min, max, indices);
+  ApplyVertexWeights(indices, weight, changes);
+  return indices.size();
+}
+
+int graph::ApplyObservations(const std::vector<TileObservation> &observations, ChangeSet &changes)
+{
+  changes.Clear();
+  // Coalesce: sort by tile and keep the last observation of each one, dropping the tiles that cannot be vertices.
+  std::vector<TileObservation> latest(observations);
+  std::stable_sort(latest.begin(), latest.end(), [](const TileObservation &a, const TileObservation &b)
+                   { return a.tile < b.tile; });
+  size_t kept = 0;
+  for (size_t i = 0; i < latest.size(); i++)
+  {
+    if (i + 1 < latest.size() && latest[i + 1].tile == latest[i].tile)
+      continue;
+    if (!latest[i].tile.InKeyRange())
+      continue;
+    latest[kept++] = latest[i];
+  }
+  latest.resize(kept);
+  auto find_observation = [&](const Tile &tile) -> const TileObservation *
+  {
+    auto it = std::lower_bound(latest.begin(), latest.end(), tile, [](const TileObservation &a, const Tile &b)
+                               { return a.tile < b; });
+    return it != latest.end() && it->tile == tile ? &*it : nullptr;
+  };
+
+  for (const TileObservation &observation : latest)
+  {
+    int32_t index = InsertVertex(observation.tile);
+    if (index != -1)
+      changes.added_vertices.push_back(index);
+  }
+
+  const int32_t dy[4] = {1, 0, -1, 0};
+  const int32_t dx[4] = {0, 1, 0, -1};
+  for (const TileObservation &observation : latest)
+  {
+    int32_t index = GetNode(observation.tile);
+    for (int side = 0; side < 4; side++)
+    {
+      Tile neighbour = {observation.tile.y + dy[side], observation.tile.x + dx[side], observation.tile.z};
+      int32_t index_neighbour = GetNode(neighbour);
+      if (index_neighbour == -1)
+        continue;
+      // A pair of observed tiles is handled once, from the lower tile.
+      const TileObservation *other = find_observation(neighbour);
+      if (other != nullptr && neighbour < observation.tile)
+        continue;
+      bool open = !(observation.walls & (1 << side)) && (other == nullptr || !(other->walls & (1 << ((side + 2) % 4))));
+      uint16_t reverse_weight = other != nullptr ? other->weight : observation.weight;
+      std::pair<int32_t, int32_t> edge = {std::min(index, index_neighbour), std::max(index, index_neighbour)};
+      bool adjacent = AuxAreAdjacent(index, index_neighbour, graph_);
+      if (open && adjacent)
+      {
+        SetHalfEdgeWeight(index, index_neighbour, observation.weight, graph_, changes);
+        if (other != nullptr)
+          SetHalfEdgeWeight(index_neighbour, index, reverse_weight, graph_, changes);
+      }
+      else if (open)
+      {
+        AddHalfEdge(index, index_neighbour, observation.weight, graph_);
+        AddHalfEdge(index_neighbour, index, reverse_weight, graph_);
+        MoveDegree(graph_[index].degree - 1, graph_[index].degree);
+        MoveDegree(graph_[index_neighbour].degree - 1, graph_[index_neighbour].degree);
+        num_edges_++;
+        total_weight_ += observation.weight + reverse_weight;
+        if (!components_dirty_)
+          UniteComponents(index, index_neighbour);
+        changes.added_edges.push_back(edge);
+        changes.vertices.push_back(index);
+        changes.vertices.push_back(index_neighbour);
+      }
+      else if (adjacent)
+      {
+        total_weight_ -= RemoveHalfEdge(index, index_neighbour, graph_);
+        total_weight_ -= RemoveHalfEdge(index_neighbour, index, graph_);
+        MoveDegree(graph_[index].degree + 1, graph_[index].degree);
+        MoveDegree(graph_[index_neighbour].degree + 1, graph_[index_neighbour].degree);
+        num_edges_--;
+        components_dirty_ = true;
+        changes.removed_edges.push_back(edge);
+        changes.vertices.push_back(index);
+        changes.vertices.push_back(index_neighbour);
+      }
+    }
+  }
+  FinishChangeSet(changes);
+  return latest.size();
+}
+
+uint64_t graph::Version() const
+{
+  return version_;
+}
+
+int graph::NumVertices() const
+{
+  return graph_.size() - num_removed_;
+}
+
+int32_t graph::NumVertexSlots() const
+{
+  return graph_.size();
+}
+
+int graph::NumEdges() const
+{
+  return num_edges_;
+}
+
+bool graph::NodeDegree(Tile t, int &degree) const
+{
+  int32_t index = GetNode(t);
+  if (index < 0)
+    return false;
+  degree += graph_[index].degree;
   return true;
 }
 
+// The MoveDegree function moves one vertex between two buckets of the degree histogram, -1 meaning none.
+void graph::MoveDegree(int32_t old_degree, int32_t new_degree)
+{
+  if (old_degree >= 0)
+    degree_histogram_[old_degree]--;
+  if (new_degree < 0)
+    return;
+  if (new_degree >= (int32_t)degree_histogram_.size())
+    degree_histogram_.resize(new_degree + 1, 0);
+  degree_histogram_[new_degree]++;
+}
+
+void graph::GetStatistics(GraphStatistics &stats) const
+{
+  stats.num_vertices = graph_.size() - num_removed_;
+  stats.num_edges = num_edges_;
+  stats.total_weight = total_weight_;
+  stats.degree_histogram = degree_histogram_;
+  while (!stats.degree_histogram.empty() && stats.degree_histogram.back() == 0)
+  {
+    stats.degree_histogram.pop_back();
+  }
+  stats.floor_vertices.clear();
+  for (const auto &floor : floors_)
+  {
+    stats.floor_vertices.push_back({floor.first, (int32_t)floor.second.vertices.size()});
+  }
+  std::sort(stats.floor_vertices.begin(), stats.floor_vertices.end());
+}
+
+bool graph::CheckInvariants() const
+{
+  int32_t n = graph_.size();
+  if ((int32_t)tile_y_.size() != n || (int32_t)tile_x_.size() != n || (int32_t)tile_z_.size() != n || (int32_t)alive_.size() != n || (int32_t)index_slot_.size() != n)
+    return false;
+
+  int32_t num_dead = 0;
+  int64_t num_half_edges = 0;
+  uint64_t total_weight = 0;
+  std::vector<int32_t> degree_histogram;
+  for (int32_t i = 0; i < n; i++)
+  {
+    const Vertex &vertex = graph_[i];
+    bool overflows = vertex.degree > Vertex::kInlineEdges;
+    if (vertex.degree < 0 || overflows != !vertex.overflow.empty() || (overflows && (int32_t)vertex.overflow.size() != vertex.degree))
+      return false;
+    if (!alive_[i])
+    {
+      num_dead++;
+      auto it = index_.find(GetTile(i).Key());
+      if (vertex.degree != 0 || (it != index_.end() && it->second == i))
+        return false;
+      continue;
+    }
+    auto it = index_.find(GetTile(i).Key());
+    if (it == index_.end() || it->second != i || slot_index_[index_slot_[i]] != i)
+      return false;
+    auto cell = cells_.find(Tile{tile_y_[i] >> kSpatialCellBits, tile_x_[i] >> kSpatialCellBits, tile_z_[i]}.Key());
+    if (cell == cells_.end() || std::find(cell->second.begin(), cell->second.end(), i) == cell->second.end())
+      return false;
+
+    const HalfEdge *edges = vertex.Edges();
+    for (int32_t e = 0; e < vertex.degree; e++)
+    {
+      int32_t to = edges[e].vertex_index;
+      if (to < 0 || to >= n || to == i || !alive_[to] || FindHalfEdge(to, i, graph_) == -1)
+        return false;
+      for (int32_t other = 0; other < e; other++)
+      {
+        if (edges[other].vertex_index == to)
+          return false;
+      }
+      total_weight += edges[e].weight;
+    }
+    num_half_edges += vertex.degree;
+    if (vertex.degree >= (int32_t)degree_histogram.size())
+      degree_histogram.resize(vertex.degree + 1, 0);
+    degree_histogram[vertex.degree]++;
+  }
+
+  std::vector<int32_t> counted_histogram = degree_histogram_;
+  counted_histogram.resize(std::max(counted_histogram.size(), degree_histogram.size()), 0);
+  degree_histogram.resize(counted_histogram.size(), 0);
+  if (num_dead != num_removed_ || num_half_edges != 2 * (int64_t)num_edges_ || total_weight != total_weight_ || degree_histogram != counted_histogram)
+    return false;
+
+  size_t floor_vertices = 0;
+  for (const auto &floor : floors_)
+  {
+    floor_vertices += floor.second.vertices.size();
+  }
+  return (int32_t)index_.size() == n - num_dead && (int32_t)floor_vertices == n - num_dead;
+}
+
 bool graph::AreAdjacent(Tile v1, Tile v2)
 {
-  int32_t index_from = -1;
-  int32_t index_to = -1;
-  if (!IsVertexIn(v1, index_from, graph_) || !IsVertexIn(v2, index_to, graph_))
+  int32_t index_from = GetNode(v1);
+  int32_t index_to = GetNode(v2);
+  if (index_from == -1 || index_to == -1)
     return false;
   return AuxAreAdjacent(index_from, index_to, graph_);
 }
 
+Tile graph::GetTile(int32_t index) const
+{
+  return {tile_y_[index], tile_x_[index], tile_z_[index]};
+}
+
+// The bounding box scans below read whole axis columns with branch-free selects,
+// so the compiler can vectorise them.
+bool graph::GetBoundingBox(Tile &min, Tile &max) const
+{
+  int32_t n = graph_.size();
+  if (n == 0)
+    return false;
+  min = {INT32_MAX, INT32_MAX, INT32_MAX};
+  max = {INT32_MIN, INT32_MIN, INT32_MIN};
+  const uint8_t *alive = alive_.data();
+  for (int32_t i = 0; i < n; i++)
+  {
+    min.y = std::min(min.y, alive[i] ? tile_y_[i] : INT32_MAX);
+    max.y = std::max(max.y, alive[i] ? tile_y_[i] : INT32_MIN);
+  }
+  for (int32_t i = 0; i < n; i++)
+  {
+    min.x = std::min(min.x, alive[i] ? tile_x_[i] : INT32_MAX);
+    max.x = std::max(max.x, alive[i] ? tile_x_[i] : INT32_MIN);
+  }
+  for (int32_t i = 0; i < n; i++)
+  {
+    min.z = std::min(min.z, alive[i] ? tile_z_[i] : INT32_MAX);
+    max.z = std::max(max.z, alive[i] ? tile_z_[i] : INT32_MIN);
+  }
+  return min.y <= max.y;
+}
+
+bool graph::GetFloorBoundingBox(int32_t z, Tile &min, Tile &max) const
+{
+  int32_t n = graph_.size();
+  int32_t min_y = INT32_MAX, max_y = INT32_MIN;
+  int32_t min_x = INT32_MAX, max_x = INT32_MIN;
+  const int32_t *ys = tile_y_.data();
+  const int32_t *xs = tile_x_.data();
+  const int32_t *zs = tile_z_.data();
+  const uint8_t *alive = alive_.data();
+  for (int32_t i = 0; i < n; i++)
+  {
+    bool on_floor = zs[i] == z && alive[i];
+    min_y = on_floor && ys[i] < min_y ? ys[i] : min_y;
+    max_y = on_floor && ys[i] > max_y ? ys[i] : max_y;
+    min_x = on_floor && xs[i] < min_x ? xs[i] : min_x;
+    max_x = on_floor && xs[i] > max_x ? xs[i] : max_x;
+  }
+  if (min_y > max_y)
+    return false;
+  min = {min_y, min_x, z};
+  max = {max_y, max_x, z};
+  return true;
+}
+
+int32_t graph::CountFloorTiles(int32_t z) const
+{
+  int32_t n = graph_.size();
+  int32_t count = 0;
+  const int32_t *zs = tile_z_.data();
+  const uint8_t *alive = alive_.data();
+  for (int32_t i = 0; i < n; i++)
+  {
+    count += (zs[i] == z) & alive[i];
+  }
+  return count;
+}
+
+NeighbourRange graph::Neighbours(int32_t index) const
+{
+  return NeighbourRange(graph_[index].Edges(), graph_[index].degree);
+}
+
+NeighbourRange graph::Neighbours(const Tile &tile) const
+{
+  int32_t index = GetNode(tile);
+  if (index == -1)
+    return NeighbourRange(nullptr, 0);
+  return Neighbours(index);
+}
+
+//--------------------
+
+void graph::AddToSpatialIndex(int32_t index)
+{
+  int32_t z = tile_z_[index];
+  int32_t cell_y = tile_y_[index] >> kSpatialCellBits;
+  int32_t cell_x = tile_x_[index] >> kSpatialCellBits;
+  cells_[Tile{cell_y, cell_x, z}.Key()].push_back(index);
+
+  auto it = floors_.find(z);
+  if (it == floors_.end())
+  {
+    floors_.emplace(z, FloorIndex{{index}, cell_y, cell_y, cell_x, cell_x});
+    return;
+  }
+  FloorIndex &floor = it->second;
+  floor.vertices.push_back(index);
+  floor.min_cell_y = std::min(floor.min_cell_y, cell_y);
+  floor.max_cell_y = std::max(floor.max_cell_y, cell_y);
+  floor.min_cell_x = std::min(floor.min_cell_x, cell_x);
+  floor.max_cell_x = std::max(floor.max_cell_x, cell_x);
+}
+
+// The RemoveFromSpatialIndex function drops a vertex from its cell and its floor.
+// The cell range of the floor is left as is: it only has to cover the vertices.
+void graph::RemoveFromSpatialIndex(int32_t index)
+{
+  int32_t z = tile_z_[index];
+  uint64_t cell_key = Tile{tile_y_[index] >> kSpatialCellBits, tile_x_[index] >> kSpatialCellBits, z}.Key();
+  std::vector<int32_t> &cell = cells_[cell_key];
+  cell.erase(std::find(cell.begin(), cell.end(), index));
+  if (cell.empty())
+    cells_.erase(cell_key);
+  std::vector<int32_t> &floor = floors_[z].vertices;
+  floor.erase(std::find(floor.begin(), floor.end(), index));
+  if (floor.empty())
+    floors_.erase(z);
+}
+
+// The FindNearestTile function visits the cells around the query in rings of growing
+// Chebyshev radius, and stops once no tile of the next ring can beat the best one found.
+bool graph::FindNearestTile(const Tile &query, Tile &nearest) const
+{
+  auto floor_it = floors_.find(query.z);
+  if (floor_it == floors_.end())
+    return false;
+  const FloorIndex &floor = floor_it->second;
+  const int32_t cell_size = 1 << kSpatialCellBits;
+  int32_t query_cell_y = query.y >> kSpatialCellBits;
+  int32_t query_cell_x = query.x >> kSpatialCellBits;
+  int32_t max_radius = std::max(std::max(std::abs(query_cell_y - floor.min_cell_y), std::abs(query_cell_y - floor.max_cell_y)),
+                                std::max(std::abs(query_cell_x - floor.min_cell_x), std::abs(query_cell_x - floor.max_cell_x)));
+
+  // Rings closer than the floor's cell range are empty, and each ring is clipped to that range,
+  // so a query far from the floor costs no more than one next to it.
+  int32_t min_radius = std::max(std::max(floor.min_cell_y - query_cell_y, query_cell_y - floor.max_cell_y),
+                                std::max(floor.min_cell_x - query_cell_x, query_cell_x - floor.max_cell_x));
+  int64_t best_dist = INT64_MAX;
+  int32_t best_index = -1;
+  for (int32_t radius = std::max(min_radius, 0); radius <= max_radius; radius++)
+  {
+    // Any tile in ring r is at least (r - 1) * cell_size + 1 away along one axis.
+    if (radius > 0 && best_index != -1)
+    {
+      int64_t bound = (int64_t)(radius - 1) * cell_size + 1;
+      if (bound * bound > best_dist)
+        break;
+    }
+    int32_t first_cell_y = std::max(query_cell_y - radius, floor.min_cell_y);
+    int32_t last_cell_y = std::min(query_cell_y + radius, floor.max_cell_y);
+    for (int32_t cell_y = first_cell_y; cell_y <= last_cell_y; cell_y++)
+    {
+      bool edge_row = cell_y == query_cell_y - radius || cell_y == query_cell_y + radius;
+      int32_t step = edge_row ? 1 : 2 * radius;
+      for (int32_t cell_x = query_cell_x - radius; cell_x <= query_cell_x + radius; cell_x += step)
+      {
+        if (cell_x < floor.min_cell_x || cell_x > floor.max_cell_x)
+        {
+          // On an edge row, jump straight to the part of the row inside the floor's range.
+          if (edge_row && cell_x < floor.min_cell_x)
+            cell_x = floor.min_cell_x - 1;
+          else if (edge_row)
+            break;
+          continue;
+        }
+        auto cell_it = cells_.find(Tile{cell_y, cell_x, query.z}.Key());
+        if (cell_it != cells_.end())
+        {
+          for (int32_t index : cell_it->second)
+          {
+            int64_t dy = tile_y_[index] - query.y;
+            int64_t dx = tile_x_[index] - query.x;
+            int64_t dist = dy * dy + dx * dx;
+            if (dist < best_dist || (dist == best_dist && index < best_index))
+            {
+              best_dist = dist;
+              best_index = index;
+            }
+          }
+        }
+      }
+    }
+  }
+  if (best_index == -1)
+    return false;
+  nearest = GetTile(best_index);
+  return true;
+}
+
+void graph::GetVerticesInBox(const Tile &min, const Tile &max, std::vector<int32_t> &indices) const
+{
+  // Only the floors that exist are visited, in increasing z, whatever the width of the z range.
+  std::vector<int32_t> floors;
+  for (const auto &floor : floors_)
+  {
+    if (floor.first >= min.z && floor.first <= max.z)
+      floors.push_back(floor.first);
+  }
+  std::sort(floors.begin(), floors.end());
+  for (int32_t z : floors)
+  {
+    const FloorIndex &floor = floors_.find(z)->second;
+    int32_t first_cell_y = std::max(min.y >> kSpatialCellBits, floor.min_cell_y);
+    int32_t last_cell_y = std::min(max.y >> kSpatialCellBits, floor.max_cell_y);
+    int32_t first_cell_x = std::max(min.x >> kSpatialCellBits, floor.min_cell_x);
+    int32_t last_cell_x = std::min(max.x >> kSpatialCellBits, floor.max_cell_x);
+    for (int32_t cell_y = first_cell_y; cell_y <= last_cell_y; cell_y++)
+    {
+      for (int32_t cell_x = first_cell_x; cell_x <= last_cell_x; cell_x++)
+      {
+        auto cell_it = cells_.find(Tile{cell_y, cell_x, z}.Key());
+        if (cell_it == cells_.end())
+          continue;
+        for (int32_t index : cell_it->second)
+        {
+          if (tile_y_[index] >= min.y && tile_y_[index] <= max.y && tile_x_[index] >= min.x && tile_x_[index] <= max.x)
+            indices.push_back(index);
+        }
+      }
+    }
+  }
+}
+
+void graph::GetTilesInBox(const Tile &min, const Tile &max, std::vector<Tile> &tiles) const
+{
+  std::vector<int32_t> indices;
+  GetVerticesInBox(min, max, indices);
+  for (int32_t index : indices)
+  {
+    tiles.push_back(GetTile(index));
+  }
+}
+
+void graph::GetFloorTiles(int32_t z, std::vector<Tile> &tiles) const
+{
+  auto floor_it = floors_.find(z);
+  if (floor_it == floors_.end())
+    return;
+  for (int32_t index : floor_it->second.vertices)
+  {
+    tiles.push_back(GetTile(index));
+  }
+}
+
 std::vector<Tile> graph::GetAdjacencyList(Tile v1)
 {
   std::vector<Tile> tile_vect;
-  if (GetNode(v1) != -1)
+  for (const EdgeView &edge : Neighbours(v1))
   {
-    Vertex aux = graph_.at(GetNode(v1));
-    HalfEdge *edges = aux.adjacency_list;
-    while (edges != nullptr)
-    {
-      tile_vect.push_back(graph_.at(edges->vertex_index).tile);
-      edges = edges->next_edge;
-    }
+    tile_vect.push_back(GetTile(edge.vertex_index));
   }
   return tile_vect;
 }
@@ -303,92 +1328,54 @@ std::vector<Tile> graph::GetAdjacencyList(Tile v1)
 std::vector<std::pair <Tile, uint16_t>> graph::GetWeightedAdjacencyList(Tile v1)
 {
   std::vector<std::pair <Tile, uint16_t>> tile_vect;
-  if (GetNode(v1) != -1)
+  for (const EdgeView &edge : Neighbours(v1))
   {
-    Vertex aux = graph_.at(GetNode(v1));
-    HalfEdge *edges = aux.adjacency_list;
-    while (edges != nullptr)
-    {
-      tile_vect.push_back(std::pair(graph_.at(edges->vertex_index).tile, edges->weight));
-      edges = edges->next_edge;
-    }
+    tile_vect.push_back(std::pair(GetTile(edge.vertex_index), edge.weight));
   }
   return tile_vect;
-
 }
 
-void graph::PrintGraph()
+void graph::PrintGraph(std::ostream &os)
 {
-  std::cout << "Graph:\n";
+  os << "Graph:\n";
   for (int32_t i = 0; i < graph_.size(); i++)
   {
-    std::cout << "(" << graph_.at(i).tile << ") |->| ";
-    HalfEdge *adjnode = graph_.at(i).adjacency_list;
-    while (adjnode != nullptr)
+    if (!alive_[i])
+      continue;
+    os << "(" << GetTile(i) << ") |->| ";
+    bool first = true;
+    for (const EdgeView &edge : Neighbours(i))
     {
-      std::cout << "(" << graph_.at(adjnode->vertex_index).tile << ")"
-                << " <- Weight: " << adjnode->weight;
-      if (adjnode->next_edge == nullptr)
-        break;
-      std::cout << " || ";
-      adjnode = adjnode->next_edge;
+      if (!first)
+        os << " || ";
+      os << "(" << GetTile(edge.vertex_index) << ")"
+                << " <- Weight: " << edge.weight;
+      first = false;
     }
-    std::cout << std::endl;
+    os << '\n';
   }
 }
 
-void graph::PrintMaze()
+void graph::PrintMaze(std::ostream &os)
 {
-  if (graph_.size() == 0)
+  Tile bounds_min, bounds_max;
+  if (!GetBoundingBox(bounds_min, bounds_max))
   {
     return;
   }
-  std::vector<Tile> ordered_nodes;
-  ordered_nodes.reserve(1000);
-  for (int32_t i = 0; i < graph_.size(); i++)
-  {
-    int32_t temp_index = 0;
-    for (int32_t j = 0; j < ordered_nodes.size(); j++)
-    {
-      if (graph_.at(i).tile < ordered_nodes.at(j))
-      {
-        break;
-      }
-      temp_index++;
-    }
-    ordered_nodes.insert(ordered_nodes.begin() + temp_index, graph_.at(i).tile);
-  }
-
-  int32_t min_z = ordered_nodes.at(0).z;
-  int32_t max_z = ordered_nodes.at(ordered_nodes.size() - 1).z;
+  int32_t min_z = bounds_min.z;
+  int32_t max_z = bounds_max.z;
 
   for (int8_t z = min_z; z <= max_z; z++)
   {
-    std::cout << "Floor: " << (int)z << "\n";
-    int32_t max_x = ordered_nodes.at(0).x;
-    int32_t min_x = ordered_nodes.at(0).x;
-    int32_t max_y = ordered_nodes.at(0).y;
-    int32_t min_y = ordered_nodes.at(0).y;
-    for (int i = 0; i < ordered_nodes.size(); i++)
-    {
-      if (z == ordered_nodes.at(i).z)
-        max_x = ordered_nodes.at(i).x;
-      min_x = ordered_nodes.at(i).x;
-      max_y = ordered_nodes.at(i).y;
-      min_y = ordered_nodes.at(i).y;
-      break;
-    }
-    for (int i = 0; i < ordered_nodes.size(); i++)
-    {
-      if (max_x < ordered_nodes.at(i).x && z == ordered_nodes.at(i).z)
-        max_x = ordered_nodes.at(i).x;
-      if (min_x > ordered_nodes.at(i).x && z == ordered_nodes.at(i).z)
-        min_x = ordered_nodes.at(i).x;
-      if (max_y < ordered_nodes.at(i).y && z == ordered_nodes.at(i).z)
-        max_y = ordered_nodes.at(i).y;
-      if (min_y > ordered_nodes.at(i).y && z == ordered_nodes.at(i).z)
-        min_y = ordered_nodes.at(i).y;
-    }
+    os << "Floor: " << (int)z << "\n";
+    Tile floor_min, floor_max;
+    if (!GetFloorBoundingBox(z, floor_min, floor_max))
+      continue;
+    int32_t max_x = floor_max.x;
+    int32_t min_x = floor_min.x;
+    int32_t max_y = floor_max.y;
+    int32_t min_y = floor_min.y;
 
     for (int8_t y = max_y; y >= min_y; y--)
     {
@@ -402,17 +1389,17 @@ void graph::PrintMaze()
             {
               if (GetNode({y + 1, x, z}) != -1)
               {
-                std::cout << "+---";
+                os << "+---";
               }
               else
               {
                 if (GetNode({y, x - 1, z}) != -1)
                 {
-                  std::cout << "+   ";
+                  os << "+   ";
                 }
                 else
                 {
-                  std::cout << "    ";
+                  os << "    ";
                 }
               }
             }
@@ -422,19 +1409,19 @@ void graph::PrintMaze()
               {
                 if (AreAdjacent({y, x, z}, {y, x - 1, z}) && AreAdjacent({y, x - 1, z}, {y + 1, x - 1, z}) && AreAdjacent({y + 1, x - 1, z}, {y + 1, x, z}))
                 {
-                  std::cout << " ";
-                  std::cout << "   ";
+                  os << " ";
+                  os << "   ";
                 }
                 else
                 {
-                  std::cout << "+";
-                  std::cout << "   ";
+                  os << "+";
+                  os << "   ";
                 }
               }
               else
               {
-                std::cout << "+";
-                std::cout << "---";
+                os << "+";
+                os << "---";
               }
             }
           }
@@ -444,11 +1431,11 @@ void graph::PrintMaze()
             {
               if (GetNode({y, x - 1, z}) != -1)
               {
-                std::cout << "|   ";
+                os << "|   ";
               }
               else
               {
-                std::cout << "    ";
+                os << "    ";
               }
             }
             else
@@ -461,18 +1448,18 @@ void graph::PrintMaze()
                 {
                   if (temp_vec.at(i).z > z)
                   {
-                    std::cout << "  U ";
+                    os << "  U ";
                     found = true;
                   }
                   else if (temp_vec.at(i).z < z)
                   {
-                    std::cout << "  D ";
+                    os << "  D ";
                     found = true;
                   }
                 }
                 if (!found)
                 {
-                  std::cout << "    ";
+                  os << "    ";
                 }
               }
               else
@@ -483,18 +1470,18 @@ void graph::PrintMaze()
                 {
                   if (temp_vec.at(i).z > z)
                   {
-                    std::cout << "| U ";
+                    os << "| U ";
                     found = true;
                   }
                   else if (temp_vec.at(i).z < z)
                   {
-                    std::cout << "| D ";
+                    os << "| D ";
                     found = true;
                   }
                 }
                 if (!found)
                 {
-                  std::cout << "|   ";
+                  os << "|   ";
                 }
               }
             }
@@ -503,16 +1490,16 @@ void graph::PrintMaze()
         if (i == 0)
         {
           if (GetNode({y, max_x, z}) != -1 || GetNode({y + 1, max_x, z}) != -1)
-            std::cout << "+\n";
+            os << "+\n";
           else
-            std::cout << "\n";
+            os << "\n";
         }
         else if (i == 1)
         {
           if (GetNode({y, max_x, z}) != -1)
-            std::cout << "|\n";
+            os << "|\n";
           else
-            std::cout << "\n";
+            os << "\n";
         }
       }
     }
@@ -522,78 +1509,46 @@ void graph::PrintMaze()
       {
         if (GetNode({min_y, x - 1, z}) == -1)
         {
-          std::cout << "    ";
+          os << "    ";
         }
         else
         {
-          std::cout << "+   ";
+          os << "+   ";
         }
       }
       else
       {
-        std::cout << "+---";
+        os << "+---";
       }
     }
     if (GetNode({min_y, max_x, z}) != -1)
-      std::cout << "+\n";
+      os << "+\n";
     else
-      std::cout << "\n";
+      os << "\n";
   }
-  std::cout << std::endl;
+  os << '\n';
 }
 
-void graph::PrintMaze(Tile current_position)
+void graph::PrintMaze(Tile current_position, std::ostream &os)
 {
-  if (graph_.size() == 0)
+  Tile bounds_min, bounds_max;
+  if (!GetBoundingBox(bounds_min, bounds_max))
   {
     return;
   }
-  std::vector<Tile> ordered_nodes;
-  ordered_nodes.reserve(1000);
-  for (int32_t i = 0; i < graph_.size(); i++)
-  {
-    int32_t temp_index = 0;
-    for (int32_t j = 0; j < ordered_nodes.size(); j++)
-    {
-      if (graph_.at(i).tile < ordered_nodes.at(j))
-      {
-        break;
-      }
-      temp_index++;
-    }
-    ordered_nodes.insert(ordered_nodes.begin() + temp_index, graph_.at(i).tile);
-  }
-
-  int32_t min_z = ordered_nodes.at(0).z;
-  int32_t max_z = ordered_nodes.at(ordered_nodes.size() - 1).z;
+  int32_t min_z = bounds_min.z;
+  int32_t max_z = bounds_max.z;
 
   for (int8_t z = min_z; z <= max_z; z++)
   {
-    std::cout << "Floor: " << (int)z << "\n";
-    int32_t max_x = ordered_nodes.at(0).x;
-    int32_t min_x = ordered_nodes.at(0).x;
-    int32_t max_y = ordered_nodes.at(0).y;
-    int32_t min_y = ordered_nodes.at(0).y;
-    for (int i = 0; i < ordered_nodes.size(); i++)
-    {
-      if (z == ordered_nodes.at(i).z)
-        max_x = ordered_nodes.at(i).x;
-      min_x = ordered_nodes.at(i).x;
-      max_y = ordered_nodes.at(i).y;
-      min_y = ordered_nodes.at(i).y;
-      break;
-    }
-    for (int i = 0; i < ordered_nodes.size(); i++)
-    {
-      if (max_x < ordered_nodes.at(i).x && z == ordered_nodes.at(i).z)
-        max_x = ordered_nodes.at(i).x;
-      if (min_x > ordered_nodes.at(i).x && z == ordered_nodes.at(i).z)
-        min_x = ordered_nodes.at(i).x;
-      if (max_y < ordered_nodes.at(i).y && z == ordered_nodes.at(i).z)
-        max_y = ordered_nodes.at(i).y;
-      if (min_y > ordered_nodes.at(i).y && z == ordered_nodes.at(i).z)
-        min_y = ordered_nodes.at(i).y;
-    }
+    os << "Floor: " << (int)z << "\n";
+    Tile floor_min, floor_max;
+    if (!GetFloorBoundingBox(z, floor_min, floor_max))
+      continue;
+    int32_t max_x = floor_max.x;
+    int32_t min_x = floor_min.x;
+    int32_t max_y = floor_max.y;
+    int32_t min_y = floor_min.y;
 
     for (int8_t y = max_y; y >= min_y; y--)
     {
@@ -607,17 +1562,17 @@ void graph::PrintMaze(Tile current_position)
             {
               if (GetNode({y + 1, x, z}) != -1)
               {
-                std::cout << "+---";
+                os << "+---";
               }
               else
               {
                 if (GetNode({y, x - 1, z}) != -1)
                 {
-                  std::cout << "+   ";
+                  os << "+   ";
                 }
                 else
                 {
-                  std::cout << "    ";
+                  os << "    ";
                 }
               }
             }
@@ -627,19 +1582,19 @@ void graph::PrintMaze(Tile current_position)
               {
                 if (AreAdjacent({y, x, z}, {y, x - 1, z}) && AreAdjacent({y, x - 1, z}, {y + 1, x - 1, z}) && AreAdjacent({y + 1, x - 1, z}, {y + 1, x, z}))
                 {
-                  std::cout << " ";
-                  std::cout << "   ";
+                  os << " ";
+                  os << "   ";
                 }
                 else
                 {
-                  std::cout << "+";
-                  std::cout << "   ";
+                  os << "+";
+                  os << "   ";
                 }
               }
               else
               {
-                std::cout << "+";
-                std::cout << "---";
+                os << "+";
+                os << "---";
               }
             }
           }
@@ -649,11 +1604,11 @@ void graph::PrintMaze(Tile current_position)
             {
               if (GetNode({y, x - 1, z}) != -1)
               {
-                std::cout << "|   ";
+                os << "|   ";
               }
               else
               {
-                std::cout << "    ";
+                os << "    ";
               }
             }
             else
@@ -662,7 +1617,7 @@ void graph::PrintMaze(Tile current_position)
               {
                 if (Tile{y, x, z} == current_position)
                 {
-                  std::cout << "  R ";
+                  os << "  R ";
                 }
                 else
                 {
@@ -672,18 +1627,18 @@ void graph::PrintMaze(Tile current_position)
                   {
                     if (temp_vec.at(i).z > z)
                     {
-                      std::cout << "  U ";
+                      os << "  U ";
                       found = true;
                     }
                     else if (temp_vec.at(i).z < z)
                     {
-                      std::cout << "  D ";
+                      os << "  D ";
                       found = true;
                     }
                   }
                   if (!found)
                   {
-                    std::cout << "    ";
+                    os << "    ";
                   }
                 }
               }
@@ -691,7 +1646,7 @@ void graph::PrintMaze(Tile current_position)
               {
                 if (Tile{y, x, z} == current_position)
                 {
-                  std::cout << "| R ";
+                  os << "| R ";
                 }
                 else
                 {
@@ -701,18 +1656,18 @@ void graph::PrintMaze(Tile current_position)
                 {
                   if (temp_vec.at(i).z > z)
                   {
-                    std::cout << "| U ";
+                    os << "| U ";
                     found = true;
                   }
                   else if (temp_vec.at(i).z < z)
                   {
-                    std::cout << "| D ";
+                    os << "| D ";
                     found = true;
                   }
                 }
                 if (!found)
                 {
-                  std::cout << "|   ";
+                  os << "|   ";
                 }
                 }
               }
@@ -722,16 +1677,16 @@ void graph::PrintMaze(Tile current_position)
         if (i == 0)
         {
           if (GetNode({y, max_x, z}) != -1 || GetNode({y + 1, max_x, z}) != -1)
-            std::cout << "+\n";
+            os << "+\n";
           else
-            std::cout << "\n";
+            os << "\n";
         }
         else if (i == 1)
         {
           if (GetNode({y, max_x, z}) != -1)
-            std::cout << "|\n";
+            os << "|\n";
           else
-            std::cout << "\n";
+            os << "\n";
         }
       }
     }
@@ -741,265 +1696,665 @@ void graph::PrintMaze(Tile current_position)
       {
         if (GetNode({min_y, x - 1, z}) == -1)
         {
-          std::cout << "    ";
+          os << "    ";
         }
         else
         {
-          std::cout << "+   ";
+          os << "+   ";
         }
       }
       else
       {
-        std::cout << "+---";
+        os << "+---";
       }
     }
     if (GetNode({min_y, max_x, z}) != -1)
-      std::cout << "+\n";
+      os << "+\n";
     else
-      std::cout << "\n";
+      os << "\n";
   }
-  std::cout << std::endl;
+  os << '\n';
 }
 
 //--------------------
 
-struct TileDistDirection
+void graph::FindPathDFS(Tile start, Tile goal, std::vector<Tile> &path, int &len)
 {
-  Tile tile;
-  double distance;
-  int direction;
-};
+  path.clear();
+  len = -1;
+  if (start == goal && GetNode(start) != -1)
+  {
+    path.push_back(start);
+    len = 0;
+    return;
+  }
+  int32_t index_start = GetNode(start);
+  int32_t index_goal = GetNode(goal);
+  if (index_start == -1 || index_goal == -1 || !AreConnected(start, goal))
+    return;
+
+  // The stack holds the current path; straight is the neighbour that keeps the direction
+  // of the move into the vertex, tried before the others.
+  struct Frame
+  {
+    int32_t vertex;
+    int32_t straight;
+    uint16_t weight;
+    NeighbourRange::iterator next;
+  };
+  std::vector<uint64_t> visited((graph_.size() + 63) / 64, 0);
+  std::vector<Frame> stack;
+  visited[index_start / 64] |= 1ull << (index_start % 64);
+  stack.push_back({index_start, -1, 0, Neighbours(index_start).begin()});
+  while (!stack.empty())
+  {
+    Frame &frame = stack.back();
+    int32_t u = frame.vertex;
+    int32_t v = -1;
+    uint16_t weight = 0;
+    if (frame.straight != -1)
+    {
+      v = frame.straight;
+      frame.straight = -1;
+      for (const EdgeView &edge : Neighbours(u))
+      {
+        if (edge.vertex_index == v)
+          weight = edge.weight;
+      }
+    }
+    else if (frame.next != Neighbours(u).end())
+    {
+      v = (*frame.next).vertex_index;
+      weight = (*frame.next).weight;
+      ++frame.next;
+    }
+    else
+    {
+      stack.pop_back();
+      continue;
+    }
+    if (visited[v / 64] & (1ull << (v % 64)))
+      continue;
+    visited[v / 64] |= 1ull << (v % 64);
+
+    if (v == index_goal)
+    {
+      len = weight;
+      for (const Frame &step : stack)
+      {
+        path.push_back(GetTile(step.vertex));
+        len += step.weight;
+      }
+      path.push_back(goal);
+      return;
+    }
+    int32_t straight = -1;
+    if (tile_z_[v] == tile_z_[u])
+    {
+      int32_t y = 2 * tile_y_[v] - tile_y_[u];
+      int32_t x = 2 * tile_x_[v] - tile_x_[u];
+      for (const EdgeView &edge : Neighbours(v))
+      {
+        if (tile_y_[edge.vertex_index] == y && tile_x_[edge.vertex_index] == x && tile_z_[edge.vertex_index] == tile_z_[v])
+          straight = edge.vertex_index;
+      }
+    }
+    stack.push_back({v, straight, weight, Neighbours(v).begin()});
+  }
+}
 
+// The PathCacheKey function packs the start index, the goal index and the heading of a search in 64 bits.
+uint64_t PathCacheKey(int32_t index_start, int32_t index_goal, int direction)
+{
+  return (uint64_t)index_start << 33 | (uint64_t)index_goal << 2 | (uint64_t)direction;
+}
 
-// Heuristic function for A* algorithm
-int32_t Heuristic(const Tile &current, const Tile &goal)
+void graph::FindPathAStar(const Tile &start, const Tile &goal, std::vector<Tile> &path, int &len, int const direction)
 {
-  // Calcolo della distanza di Euclidea come euristica
-  return sqrt(pow((current.x - goal.x), 2) + pow((current.y - goal.y), 2));
+  FindPathAStarCached(start, goal, path, len, direction, nullptr);
 }
 
-struct TileHasher
+// The FindPathAStarCached function answers from the path cache, or runs the search and caches its result.
+// A cached path is converted to maneuvers with GetManeuvers, a searched one while its states are walked.
+void graph::FindPathAStarCached(const Tile &start, const Tile &goal, std::vector<Tile> &path, int &len, int const direction, std::vector<Maneuver> *maneuvers)
 {
-  std::size_t operator()(const Tile &tile) const
+  if (maneuvers != nullptr)
+    maneuvers->clear();
+  int32_t index_start = GetNode(start);
+  int32_t index_goal = GetNode(goal);
+  bool cacheable = path_cache_capacity_ > 0 && index_start != -1 && index_goal != -1 && direction >= 0 && direction < 4;
+  uint64_t key = cacheable ? PathCacheKey(index_start, index_goal, direction) : 0;
+  if (cacheable)
   {
-    std::size_t h1 = std::hash<int32_t>{}(tile.y);
-    std::size_t h2 = std::hash<int32_t>{}(tile.x);
-    std::size_t h3 = std::hash<int32_t>{}(tile.z);
-    return h1 ^ (h2 << 1) ^ (h3 << 2);
+    for (CachedPath &cached : path_cache_)
+    {
+      if (cached.key == key && cached.version == version_)
+      {
+        cached.last_used = ++path_cache_tick_;
+        MAZE_LOG_RECORD(LogLevel::Debug, LogEvent::PathCacheHit, index_start, index_goal, cached.len);
+        path.clear();
+        for (int32_t index : cached.vertices)
+        {
+          path.push_back(GetTile(index));
+        }
+        len = cached.len;
+        if (maneuvers != nullptr && len != -1)
+          GetManeuvers(path, direction, *maneuvers);
+        return;
+      }
+    }
   }
-};
 
-struct CompareDist
-{
-  bool operator()(const TileDistDirection &a, const TileDistDirection &b)
+  // The search uses the table of the goal only if one is cached; callers with repeated goals call GetHeuristicTable.
+  AStarSearch search(*this);
+  search.Start(start, goal, direction);
+  search.Step(-1);
+  if (maneuvers != nullptr)
+    search.GetPath(path, len, *maneuvers);
+  else
+    search.GetPath(path, len);
+  if (!cacheable)
+    return;
+
+  // Reuse the stale entry of the same search if there is one, otherwise evict the least recently used.
+  CachedPath *slot = nullptr;
+  for (CachedPath &cached : path_cache_)
+  {
+    if (cached.key == key)
+    {
+      slot = &cached;
+      break;
+    }
+  }
+  if (slot == nullptr && path_cache_.size() < path_cache_capacity_)
+  {
+    path_cache_.emplace_back();
+    slot = &path_cache_.back();
+  }
+  if (slot == nullptr)
+  {
+    slot = &*std::min_element(path_cache_.begin(), path_cache_.end(), [](const CachedPath &a, const CachedPath &b)
+                              { return a.last_used < b.last_used; });
+  }
+  slot->key = key;
+  slot->version = version_;
+  slot->last_used = ++path_cache_tick_;
+  slot->vertices.clear();
+  for (const Tile &tile : path)
   {
-    return a.distance > b.distance; // Ordine crescente in base alla distanza
+    slot->vertices.push_back(GetNode(tile));
   }
-};
+  slot->len = len;
+}
+
+void graph::FindPathAStar(const Tile &start, const Tile &goal, std::vector<Tile> &path, int &len, int const direction, std::vector<Maneuver> &maneuvers)
+{
+  FindPathAStarCached(start, goal, path, len, direction, &maneuvers);
+}
 
-struct DistanceCalculator
+// The FindPathReference function runs Dijkstra over the states vertex * 4 + heading,
+// with a heap of (cost << 32 | state) keys ordered by one integer comparison.
+void graph::FindPathReference(const Tile &start, const Tile &goal, std::vector<Tile> &path, int &len, int const direction) const
 {
-  double operator()(const Tile &node1, const Tile &node2) const
+  path.clear();
+  len = -1;
+  if (start == goal)
   {
-    return sqrt(pow((node1.x - node2.x), 2) + pow((node1.y - node2.y), 2));
+    path.push_back(start);
+    len = 0;
+    return;
   }
-};
+  int32_t index_start = GetNode(start);
+  int32_t index_goal = GetNode(goal);
+  if (index_start == -1 || index_goal == -1 || direction < 0 || direction > 3)
+    return;
 
-struct Distance {
-  double operator()(const TileDistDirection& node1, const Tile& node2, int &new_direction) const {
-    int dx = node1.tile.x - node2.x;
-    int dy = node1.tile.y - node2.y;
-    int dz = node1.tile.z - node2.z;
-    int turn_weight = 0;
-    if (node1.direction == 0 || node1.direction == 2)
+  int32_t num_states = 4 * graph_.size();
+  std::vector<int64_t> cost(num_states, INT64_MAX);
+  std::vector<int32_t> predecessor(num_states, -1);
+  std::vector<std::pair<int64_t, int32_t>> heap;
+  std::greater<std::pair<int64_t, int32_t>> compare;
+  int32_t source = index_start * 4 + direction;
+  cost[source] = 0;
+  heap.push_back({0, source});
+  int32_t reached = -1;
+  while (!heap.empty())
+  {
+    std::pop_heap(heap.begin(), heap.end(), compare);
+    std::pair<int64_t, int32_t> top = heap.back();
+    heap.pop_back();
+    int32_t state = top.second;
+    if (top.first != cost[state])
+      continue;
+    int32_t index = state / 4;
+    if (index == index_goal)
     {
-      if (dx != 0)
-      {
-        turn_weight += 2;
-        if (dx > 0)
-        {
-          new_direction = 3;
-        }
-        else
-        {
-          new_direction = 1;
-        }
-      }
-      else
-      {
-        if (node1.direction == 0)
-        {
-          if (dy > 0)
-          {
-            turn_weight += 4;
-            new_direction = 2;
-          }
-        }
-        else
-        {
-          if (dy < 0)
-          {
-            turn_weight += 4;
-            new_direction = 0;
-          }
-        }
-      }
+      reached = state;
+      break;
     }
-    else
+    Tile from = GetTile(index);
+    for (const EdgeView &edge : Neighbours(index))
     {
-      if (dy != 0)
-      {
-        turn_weight += 2;
-        if (node1.tile.y - node2.y > 0)
-        {
-          new_direction = 2;
-        }
-        else
-        {
-          new_direction = 0;
-        }
-      }
-      else
+      int new_direction;
+      int64_t new_cost = top.first + cost_policy_.StepCost(from, state % 4, GetTile(edge.vertex_index), edge.weight, new_direction);
+      int32_t next = edge.vertex_index * 4 + new_direction;
+      if (new_cost < cost[next])
       {
-        if (node1.direction == 1)
-        {
-          if (dx > 0)
-          {
-            turn_weight += 4;
-          }
-        }
-        else
-        {
-          if (dx < 0)
-          {
-            turn_weight += 4;
-          }
-        }
+        cost[next] = new_cost;
+        predecessor[next] = state;
+        heap.push_back({new_cost, next});
+        std::push_heap(heap.begin(), heap.end(), compare);
       }
     }
+  }
+  if (reached == -1)
+    return;
+  for (int32_t state = reached; state != -1; state = predecessor[state])
+  {
+    path.push_back(GetTile(state / 4));
+  }
+  std::reverse(path.begin(), path.end());
+  len = cost[reached];
+}
+
+// The AppendManeuver function merges a move into the last maneuver when both are moves of the same type.
+void AppendManeuver(ManeuverType type, int32_t cost, std::vector<Maneuver> &maneuvers)
+{
+  bool is_move = type == ManeuverType::Forward || type == ManeuverType::RampUp || type == ManeuverType::RampDown;
+  if (is_move && !maneuvers.empty() && maneuvers.back().type == type)
+  {
+    maneuvers.back().count++;
+    maneuvers.back().cost += cost;
+    return;
+  }
+  maneuvers.push_back({type, 1, cost});
+}
 
-    /* Ramp
-    if (dz != 0)
+bool graph::GetManeuvers(const std::vector<Tile> &path, int direction, std::vector<Maneuver> &maneuvers) const
+{
+  maneuvers.clear();
+  int32_t index_from = path.empty() ? -1 : GetNode(path[0]);
+  for (size_t i = 1; i < path.size(); i++)
+  {
+    int32_t index_to = GetNode(path[i]);
+    int32_t position = index_from == -1 || index_to == -1 ? -1 : FindHalfEdge(index_from, index_to, graph_);
+    if (position == -1)
+      return false;
+    int new_direction;
+    int32_t cost = cost_policy_.StepCost(path[i - 1], direction, path[i], graph_[index_from].Edges()[position].weight, new_direction);
+    int turn = (new_direction - direction + 4) % 4;
+    if (turn != 0)
     {
-      turn_weight += 5;
+      int32_t turn_cost = turn == 2 ? cost_policy_.turn_around : cost_policy_.quarter_turn;
+      AppendManeuver(turn == 1 ? ManeuverType::TurnRight : turn == 2 ? ManeuverType::TurnAround : ManeuverType::TurnLeft, turn_cost, maneuvers);
+      cost -= turn_cost;
     }
-    */
-    return turn_weight;
+    ManeuverType move = path[i].z > path[i - 1].z ? ManeuverType::RampUp : path[i].z < path[i - 1].z ? ManeuverType::RampDown : ManeuverType::Forward;
+    AppendManeuver(move, cost, maneuvers);
+    direction = new_direction;
+    index_from = index_to;
   }
-};
+  return true;
+}
 
-double potential(const Tile &node, const Tile &end)
+void graph::SetCostPolicy(const CostPolicy &policy)
 {
-  return sqrt(pow(node.x - end.x, 2) + pow(node.y - end.y, 2));
+  cost_policy_ = policy;
+  ClearPathCache();
+  version_++;
 }
 
-void graph::FindPathAStar(const Tile &start, const Tile &goal, std::vector<Tile> &path, int &len, int const direction)
+const CostPolicy &graph::GetCostPolicy() const
 {
-  path.clear();
-  std::unordered_map<Tile, double, TileHasher> dist;
-  std::priority_queue<TileDistDirection, std::vector<TileDistDirection>, CompareDist> open_nodes;
-  std::unordered_set<Tile, TileHasher> closed_nodes;
-  std::unordered_map<Tile, Tile, TileHasher> predecessor;
-  Distance distance;
-  // DistanceCalculator distance;
-
-  open_nodes.push({start, 0.0, direction});
-  dist[start] = 0.0;
+  return cost_policy_;
+}
 
-  while (!open_nodes.empty())
+std::shared_ptr<const std::vector<int32_t>> graph::FindHeuristicTable(const Tile &goal) const
+{
+  int32_t index_goal = GetNode(goal);
+  if (index_goal == -1)
+    return nullptr;
+  for (HeuristicTable &table : heuristic_tables_)
   {
-    TileDistDirection cur_node = open_nodes.top();
-    open_nodes.pop();
+    if (table.goal == index_goal && table.version == version_)
+    {
+      table.last_used = ++heuristic_tick_;
+      return table.distance;
+    }
+  }
+  return nullptr;
+}
 
-    if (cur_node.tile == goal)
+// The GetEdgeBounds function scans every half-edge once per graph version.
+void graph::GetEdgeBounds(uint16_t &min_weight, int32_t &max_span) const
+{
+  if (!edge_bounds_valid_ || edge_bounds_version_ != version_)
+  {
+    min_weight_ = UINT16_MAX;
+    max_span_ = 1;
+    bool any = false;
+    for (int32_t v = 0; v < (int32_t)graph_.size(); v++)
     {
-      Tile current = cur_node.tile;
-      while (!(current == start))
+      for (const EdgeView &edge : Neighbours(v))
       {
-        path.push_back(current);
-        current = predecessor[current];
+        int32_t u = edge.vertex_index;
+        any = true;
+        min_weight_ = std::min(min_weight_, edge.weight);
+        max_span_ = std::max(max_span_, std::abs(tile_y_[u] - tile_y_[v]) + std::abs(tile_x_[u] - tile_x_[v]) + std::abs(tile_z_[u] - tile_z_[v]));
       }
-      path.push_back(start);
-      std::reverse(path.begin(), path.end());
-      len = dist[cur_node.tile];
-      return;
     }
+    if (!any)
+      min_weight_ = 0;
+    edge_bounds_version_ = version_;
+    edge_bounds_valid_ = true;
+  }
+  min_weight = min_weight_;
+  max_span = max_span_;
+}
 
-    closed_nodes.insert(cur_node.tile);
+// The GetHeuristicTable function runs Dijkstra backwards from the goal: the cost of a half-edge u -> v
+// is the CostPolicy step cost without the turn, known once v is settled.
+std::shared_ptr<const std::vector<int32_t>> graph::GetHeuristicTable(const Tile &goal) const
+{
+  std::shared_ptr<const std::vector<int32_t>> cached = FindHeuristicTable(goal);
+  int32_t index_goal = GetNode(goal);
+  if (cached != nullptr || index_goal == -1)
+    return cached;
 
-    for (const auto &neighbor : GetWeightedAdjacencyList(cur_node.tile))
-    {
-      if (closed_nodes.count(neighbor.first) == 0)
+  HeuristicTable *table;
+  if (heuristic_tables_.size() < kHeuristicTables)
+  {
+    heuristic_tables_.emplace_back();
+    table = &heuristic_tables_.back();
+  }
+  else
+  {
+    table = &*std::min_element(heuristic_tables_.begin(), heuristic_tables_.end(), [this](const HeuristicTable &a, const HeuristicTable &b)
+                               { return (a.version == version_) != (b.version == version_) ? a.version != version_ : a.last_used < b.last_used; });
+  }
+  table->goal = index_goal;
+  table->version = version_;
+  table->last_used = ++heuristic_tick_;
+  // A table still held by a search is left to it; otherwise its buffer is reused.
+  if (table->distance == nullptr || table->distance.use_count() > 1)
+    table->distance = std::make_shared<std::vector<int32_t>>();
+  std::vector<int32_t> &distance = *table->distance;
+  distance.assign(graph_.size(), INT32_MAX);
+
+  std::vector<uint64_t> heap;
+  ShortestDistances(
+      index_goal, distance, heap,
+      [this](int32_t v, auto &relax)
       {
-        int new_direction = cur_node.direction;
-        double new_dist = dist[cur_node.tile] + distance(cur_node, neighbor.first, new_direction) + neighbor.second;
-        if (!dist.count(neighbor.first) || new_dist < dist[neighbor.first])
+        for (const EdgeView &edge : Neighbours(v))
         {
-          dist[neighbor.first] = new_dist;
-          predecessor[neighbor.first] = cur_node.tile;
-          open_nodes.push({neighbor.first, new_dist, new_direction});
+          int32_t u = edge.vertex_index;
+          uint16_t weight = edge.weight;
+          for (const EdgeView &reverse : Neighbours(u))
+          {
+            if (reverse.vertex_index == v)
+              weight = reverse.weight;
+          }
+          relax(u, std::max(cost_policy_.MoveCost(GetTile(u), GetTile(v), weight), 0));
         }
+      },
+      [](int32_t) { return true; });
+  return table->distance;
+}
+
+void graph::SetPathCacheCapacity(size_t capacity)
+{
+  path_cache_capacity_ = capacity;
+  if (path_cache_.size() <= capacity)
+    return;
+  std::sort(path_cache_.begin(), path_cache_.end(), [](const CachedPath &a, const CachedPath &b)
+            { return a.last_used > b.last_used; });
+  path_cache_.resize(capacity);
+}
+
+void graph::SetPathCacheFineGrained(bool enabled)
+{
+  path_cache_fine_grained_ = enabled;
+}
+
+void graph::ClearPathCache()
+{
+  path_cache_.clear();
+}
+
+// The RevalidatePathCache function is called by the mutations right after they bump the version.
+// Entries that were valid before the mutation are stamped with the new version if the mutation
+// cannot have changed their result; every other entry is dropped.
+void graph::RevalidatePathCache(const std::vector<uint64_t> &costlier_edges, bool cheaper)
+{
+  if (path_cache_.empty())
+    return;
+  std::vector<uint64_t> sorted_edges(costlier_edges);
+  std::sort(sorted_edges.begin(), sorted_edges.end());
+  size_t kept = 0;
+  for (size_t i = 0; i < path_cache_.size(); i++)
+  {
+    CachedPath &cached = path_cache_[i];
+    if (cached.version + 1 != version_ || cheaper)
+      continue;
+    if (!sorted_edges.empty())
+    {
+      if (!path_cache_fine_grained_)
+        continue;
+      bool traversed = false;
+      for (size_t j = 1; j < cached.vertices.size() && !traversed; j++)
+      {
+        int32_t a = cached.vertices[j - 1];
+        int32_t b = cached.vertices[j];
+        traversed = std::binary_search(sorted_edges.begin(), sorted_edges.end(), (uint64_t)std::min(a, b) << 32 | (uint32_t)std::max(a, b));
       }
+      if (traversed)
+        continue;
     }
+    cached.version = version_;
+    if (kept != i)
+      path_cache_[kept] = std::move(cached);
+    kept++;
   }
+  path_cache_.resize(kept);
+}
 
-  len = -1;
+void graph::RevalidatePathCache(int32_t index1, int32_t index2, bool cheaper)
+{
+  if (path_cache_.empty())
+    return;
+  RevalidatePathCache(std::vector<uint64_t>{(uint64_t)std::min(index1, index2) << 32 | (uint32_t)std::max(index1, index2)}, cheaper);
 }
 
 //--------------------
 
-void graph::PrintMazePath(std::vector<Tile> &path)
+AStarSearch::AStarSearch(const graph &g) : graph_(g), status_(SearchStatus::Idle), expansions_(0), direction_(0), len_(-1), state_goal_(-1), heuristic_values_(nullptr), min_weight_(0), max_span_(1) {}
+
+void AStarSearch::Start(const Tile &start, const Tile &goal, int const direction)
 {
-  if (graph_.size() == 0)
+  start_ = start;
+  goal_ = goal;
+  expansions_ = 0;
+  direction_ = direction;
+  len_ = -1;
+  index_start_ = graph_.GetNode(start);
+  index_goal_ = graph_.GetNode(goal);
+  state_goal_ = -1;
+  open_nodes_.clear();
+  status_ = SearchStatus::Running;
+
+  if (start == goal)
   {
+    len_ = 0;
+    status_ = SearchStatus::Found;
     return;
   }
-  std::vector<Tile> ordered_nodes;
-  ordered_nodes.reserve(1000);
-  for (int32_t i = 0; i < graph_.size(); i++)
+  if (index_start_ == -1 || index_goal_ == -1 || direction < 0 || direction > 3 || !graph_.AreConnected(start, goal))
   {
-    int32_t temp_index = 0;
-    for (int32_t j = 0; j < ordered_nodes.size(); j++)
-    {
-      if (graph_.at(i).tile < ordered_nodes.at(j))
-      {
-        break;
-      }
-      temp_index++;
-    }
-    ordered_nodes.insert(ordered_nodes.begin() + temp_index, graph_.at(i).tile);
+    status_ = SearchStatus::NotFound;
+    return;
   }
 
-  int32_t min_z = ordered_nodes.at(0).z;
-  int32_t max_z = ordered_nodes.at(ordered_nodes.size() - 1).z;
+  int32_t num_states = 4 * graph_.NumVertexSlots();
+  dist_.assign(num_states, -1);
+  predecessor_.assign(num_states, -1);
+  closed_nodes_.assign(num_states, 0);
+  open_nodes_.reserve(num_states);
 
-  for (int8_t z = min_z; z <= max_z; z++)
+  heuristic_ = graph_.FindHeuristicTable(goal);
+  heuristic_values_ = heuristic_ != nullptr ? heuristic_->data() : nullptr;
+  if (heuristic_values_ == nullptr)
+    graph_.GetEdgeBounds(min_weight_, max_span_);
+  double heuristic = heuristic_values_ != nullptr ? heuristic_values_[index_start_] : graph_.GetCostPolicy().LowerBound(start, goal, min_weight_, max_span_);
+  open_nodes_.push_back({heuristic, index_start_ * 4 + direction});
+  dist_[index_start_ * 4 + direction] = 0.0;
+}
+
+// The Step function pops at most max_expansions nodes from the open set.
+// It stops early when the goal is popped or when the open set runs out. Entries of states
+// already closed are stale: a cheaper entry of the same state was expanded before, so they
+// are dropped without counting as expansions.
+SearchStatus AStarSearch::Step(int max_expansions)
+{
+  const CostPolicy policy = graph_.GetCostPolicy();
+  CompareOpenNode compare;
+
+  while (status_ == SearchStatus::Running && max_expansions != 0)
   {
-    std::cout << "Floor: " << (int)z << "\n";
-    int32_t max_x = ordered_nodes.at(0).x;
-    int32_t min_x = ordered_nodes.at(0).x;
-    int32_t max_y = ordered_nodes.at(0).y;
-    int32_t min_y = ordered_nodes.at(0).y;
-    for (int i = 0; i < ordered_nodes.size(); i++)
+    if (open_nodes_.empty())
+    {
+      status_ = SearchStatus::NotFound;
+      break;
+    }
+    std::pop_heap(open_nodes_.begin(), open_nodes_.end(), compare);
+    int32_t state = open_nodes_.back().state;
+    open_nodes_.pop_back();
+    if (closed_nodes_[state])
+      continue;
+    if (max_expansions > 0)
+      max_expansions--;
+    expansions_++;
+
+    int32_t vertex_index = state / 4;
+    if (vertex_index == index_goal_)
     {
-      if (z == ordered_nodes.at(i).z)
-        max_x = ordered_nodes.at(i).x;
-      min_x = ordered_nodes.at(i).x;
-      max_y = ordered_nodes.at(i).y;
-      min_y = ordered_nodes.at(i).y;
+      len_ = dist_[state];
+      state_goal_ = state;
+      status_ = SearchStatus::Found;
       break;
     }
-    for (int i = 0; i < ordered_nodes.size(); i++)
+
+    closed_nodes_[state] = 1;
+    Tile cur = graph_.GetTile(vertex_index);
+
+    for (const EdgeView &neighbor : graph_.Neighbours(vertex_index))
     {
-      if (max_x < ordered_nodes.at(i).x && z == ordered_nodes.at(i).z)
-        max_x = ordered_nodes.at(i).x;
-      if (min_x > ordered_nodes.at(i).x && z == ordered_nodes.at(i).z)
-        min_x = ordered_nodes.at(i).x;
-      if (max_y < ordered_nodes.at(i).y && z == ordered_nodes.at(i).z)
-        max_y = ordered_nodes.at(i).y;
-      if (min_y > ordered_nodes.at(i).y && z == ordered_nodes.at(i).z)
-        min_y = ordered_nodes.at(i).y;
+      int new_direction;
+      Tile next_tile = graph_.GetTile(neighbor.vertex_index);
+      double new_dist = dist_[state] + policy.StepCost(cur, state % 4, next_tile, neighbor.weight, new_direction);
+      int32_t next = neighbor.vertex_index * 4 + new_direction;
+      if (!closed_nodes_[next] && (dist_[next] < 0 || new_dist < dist_[next]))
+      {
+        dist_[next] = new_dist;
+        predecessor_[next] = state;
+        double heuristic = heuristic_values_ != nullptr ? heuristic_values_[neighbor.vertex_index] : policy.LowerBound(next_tile, goal_, min_weight_, max_span_);
+        open_nodes_.push_back({new_dist + heuristic, next});
+        std::push_heap(open_nodes_.begin(), open_nodes_.end(), compare);
+      }
     }
+  }
+  if (status_ != SearchStatus::Running)
+    MAZE_LOG_RECORD(LogLevel::Debug, LogEvent::SearchFinished, expansions_, (int32_t)len_, index_goal_);
+  return status_;
+}
+
+SearchStatus AStarSearch::Status() const
+{
+  return status_;
+}
+
+int AStarSearch::Expansions() const
+{
+  return expansions_;
+}
+
+bool AStarSearch::GetPath(std::vector<Tile> &path, int &len)
+{
+  path.clear();
+  if (status_ != SearchStatus::Found)
+  {
+    len = -1;
+    return false;
+  }
+  if (start_ == goal_)
+  {
+    path.push_back(start_);
+    len = 0;
+    return true;
+  }
+  for (int32_t state = state_goal_; state != -1; state = predecessor_[state])
+  {
+    path.push_back(graph_.GetTile(state / 4));
+  }
+  std::reverse(path.begin(), path.end());
+  len = len_;
+  return true;
+}
+
+// The GetPath function builds the maneuvers in the predecessor walk that collects the tiles. A state carries
+// the heading, so the turn of a step is the change of heading, and its cost the difference of the distances.
+// The walk runs from the goal, so each step appends its move before its turn and both vectors are reversed.
+bool AStarSearch::GetPath(std::vector<Tile> &path, int &len, std::vector<Maneuver> &maneuvers)
+{
+  maneuvers.clear();
+  if (status_ != SearchStatus::Found || start_ == goal_)
+    return GetPath(path, len);
+  const CostPolicy &policy = graph_.GetCostPolicy();
+  path.clear();
+  for (int32_t state = state_goal_; state != -1; state = predecessor_[state])
+  {
+    Tile tile = graph_.GetTile(state / 4);
+    path.push_back(tile);
+    int32_t previous = predecessor_[state];
+    if (previous == -1)
+      continue;
+    Tile previous_tile = graph_.GetTile(previous / 4);
+    int32_t cost = (int32_t)(dist_[state] - dist_[previous]);
+    int turn = (state % 4 - previous % 4 + 4) % 4;
+    int32_t turn_cost = turn == 0 ? 0 : turn == 2 ? policy.turn_around : policy.quarter_turn;
+    ManeuverType move = tile.z > previous_tile.z ? ManeuverType::RampUp : tile.z < previous_tile.z ? ManeuverType::RampDown : ManeuverType::Forward;
+    AppendManeuver(move, cost - turn_cost, maneuvers);
+    if (turn != 0)
+      AppendManeuver(turn == 1 ? ManeuverType::TurnRight : turn == 2 ? ManeuverType::TurnAround : ManeuverType::TurnLeft, turn_cost, maneuvers);
+  }
+  std::reverse(path.begin(), path.end());
+  std::reverse(maneuvers.begin(), maneuvers.end());
+  len = len_;
+  return true;
+}
+
+//--------------------
+
+void graph::PrintMazePath(std::vector<Tile> &path, std::ostream &os)
+{
+  Tile bounds_min, bounds_max;
+  if (!GetBoundingBox(bounds_min, bounds_max))
+  {
+    return;
+  }
+  int32_t min_z = bounds_min.z;
+  int32_t max_z = bounds_max.z;
+
+  for (int8_t z = min_z; z <= max_z; z++)
+  {
+    os << "Floor: " << (int)z << "\n";
+    Tile floor_min, floor_max;
+    if (!GetFloorBoundingBox(z, floor_min, floor_max))
+      continue;
+    int32_t max_x = floor_max.x;
+    int32_t min_x = floor_min.x;
+    int32_t max_y = floor_max.y;
+    int32_t min_y = floor_min.y;
 
     for (int8_t y = max_y; y >= min_y; y--)
     {
@@ -1013,17 +2368,17 @@ void graph::PrintMazePath(std::vector<Tile> &path)
             {
               if (GetNode({y + 1, x, z}) != -1)
               {
-                std::cout << "+---";
+                os << "+---";
               }
               else
               {
                 if (GetNode({y, x - 1, z}) != -1)
                 {
-                  std::cout << "+   ";
+                  os << "+   ";
                 }
                 else
                 {
-                  std::cout << "    ";
+                  os << "    ";
                 }
               }
             }
@@ -1033,19 +2388,19 @@ void graph::PrintMazePath(std::vector<Tile> &path)
               {
                 if (AreAdjacent({y, x, z}, {y, x - 1, z}) && AreAdjacent({y, x - 1, z}, {y + 1, x - 1, z}) && AreAdjacent({y + 1, x - 1, z}, {y + 1, x, z}))
                 {
-                  std::cout << " ";
-                  std::cout << "   ";
+                  os << " ";
+                  os << "   ";
                 }
                 else
                 {
-                  std::cout << "+";
-                  std::cout << "   ";
+                  os << "+";
+                  os << "   ";
                 }
               }
               else
               {
-                std::cout << "+";
-                std::cout << "---";
+                os << "+";
+                os << "---";
               }
             }
           }
@@ -1055,11 +2410,11 @@ void graph::PrintMazePath(std::vector<Tile> &path)
             {
               if (GetNode({y, x - 1, z}) != -1)
               {
-                std::cout << "|   ";
+                os << "|   ";
               }
               else
               {
-                std::cout << "    ";
+                os << "    ";
               }
             }
             else
@@ -1072,12 +2427,12 @@ void graph::PrintMazePath(std::vector<Tile> &path)
                 {
                   if (temp_vec.at(i).z > z)
                   {
-                    std::cout << "  U ";
+                    os << "  U ";
                     found = true;
                   }
                   else if (temp_vec.at(i).z < z)
                   {
-                    std::cout << "  D ";
+                    os << "  D ";
                     found = true;
                   }
                 }
@@ -1096,20 +2451,20 @@ void graph::PrintMazePath(std::vector<Tile> &path)
                   {
                     if (Tile{y, x, z} == path.at(0))
                     {
-                      std::cout << "  S ";
+                      os << "  S ";
                     }
                     else if (Tile{y, x, z} == path.at(path.size()-1))
                     {
-                      std::cout << "  E ";
+                      os << "  E ";
                     }
                     else
                     {
-                      std::cout << "  O ";
+                      os << "  O ";
                     }
                   }
                   else
                   {
-                    std::cout << "    ";
+                    os << "    ";
                   }
                 }
               }
@@ -1121,13 +2476,13 @@ void graph::PrintMazePath(std::vector<Tile> &path)
                 {
                   if (temp_vec.at(i).z > z)
                   {
-                    std::cout << "| U ";
+                    os << "| U ";
                     found = true;
                     break;
                   }
                   else if (temp_vec.at(i).z < z)
                   {
-                    std::cout << "| D ";
+                    os << "| D ";
                     found = true;
                     break;
                   }
@@ -1147,20 +2502,20 @@ void graph::PrintMazePath(std::vector<Tile> &path)
                   {
                     if (Tile{y, x, z} == path.at(0))
                     {
-                      std::cout << "| S ";
+                      os << "| S ";
                     }
                     else if (Tile{y, x, z} == path.at(path.size()-1))
                     {
-                      std::cout << "| E ";
+                      os << "| E ";
                     }
                     else
                     {
-                      std::cout << "| O ";
+                      os << "| O ";
                     }
                   }
                   else
                   {
-                    std::cout << "|   ";
+                    os << "|   ";
                   }
                 }
               }
@@ -1170,16 +2525,16 @@ void graph::PrintMazePath(std::vector<Tile> &path)
         if (i == 0)
         {
           if (GetNode({y, max_x, z}) != -1 || GetNode({y - 1, max_x, z}) != -1)
-            std::cout << "+\n";
+            os << "+\n";
           else
-            std::cout << "\n";
+            os << "\n";
         }
         else if (i == 1)
         {
           if (GetNode({y, max_x, z}) != -1)
-            std::cout << "|\n";
+            os << "|\n";
           else
-            std::cout << "\n";
+            os << "\n";
         }
       }
     }
@@ -1189,22 +2544,22 @@ void graph::PrintMazePath(std::vector<Tile> &path)
       {
         if (GetNode({min_y, x - 1, z}) == -1)
         {
-          std::cout << "    ";
+          os << "    ";
         }
         else
         {
-          std::cout << "+   ";
+          os << "+   ";
         }
       }
       else
       {
-        std::cout << "+---";
+        os << "+---";
       }
     }
     if (GetNode({min_y, max_x, z}) != -1)
-      std::cout << "+\n";
+      os << "+\n";
     else
-      std::cout << "\n";
+      os << "\n";
   }
-  std::cout << std::endl;
-}
\ No newline at end of file
+  os << '\n';
+}
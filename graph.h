@@ -6,6 +6,8 @@
 #pragma once
 
 #include <stdint.h>
+#include <cassert>
+#include <cstdlib>
 #include <iostream>
 #include <math.h>
 #include <vector>
@@ -13,12 +15,26 @@
 #include <unordered_set>
 #include <queue>
 #include <algorithm>
+#include <functional>
+#include <memory>
+
+#include "logger.h"
+
+/**
+ * @brief Number of bits used by Tile::Key() for each axis.
+ */
+constexpr int kTileKeyAxisBits = 21;
+
+/**
+ * @brief Mask selecting one axis of a packed tile key.
+ */
+constexpr uint64_t kTileKeyAxisMask = (uint64_t(1) << kTileKeyAxisBits) - 1;
 
 /**
- * @def LOG(x)
- * @brief Macro for logging messages to the console.
+ * @brief Offset added to each coordinate before packing, so that coordinates in
+ * [-kTileKeyAxisBias, kTileKeyAxisBias) map to unsigned values with the same order.
  */
-#define LOG(x) std::cout << x << std::endl;
+constexpr int32_t kTileKeyAxisBias = 1 << (kTileKeyAxisBits - 1);
 
 /**
  * @struct Tile
@@ -28,6 +44,32 @@ struct Tile
 {
   int32_t y, x, z;
 
+  /**
+   * @brief Checks whether every coordinate lies in [-2^20, 2^20), the range Key() can pack without aliasing.
+   * @return True if the tile can be packed, false otherwise.
+   */
+  bool InKeyRange() const
+  {
+    return y >= -kTileKeyAxisBias && y < kTileKeyAxisBias &&
+           x >= -kTileKeyAxisBias && x < kTileKeyAxisBias &&
+           z >= -kTileKeyAxisBias && z < kTileKeyAxisBias;
+  }
+
+  /**
+   * @brief Packs the tile into a 64-bit key: z, y and x from the most significant bits, 21 bits each.
+   *
+   * The tile must be InKeyRange(). Two keys compare like the tiles they pack,
+   * so the key is used for indexing and hashing.
+   * @return The packed key of the tile.
+   */
+  uint64_t Key() const
+  {
+    assert(InKeyRange());
+    return ((uint64_t)(uint32_t)(z + kTileKeyAxisBias) & kTileKeyAxisMask) << (2 * kTileKeyAxisBits) |
+           ((uint64_t)(uint32_t)(y + kTileKeyAxisBias) & kTileKeyAxisMask) << kTileKeyAxisBits |
+           ((uint64_t)(uint32_t)(x + kTileKeyAxisBias) & kTileKeyAxisMask);
+  }
+
   /**
    * @brief Overloaded output stream operator for printing Tile objects.
    * @param os The output stream.
@@ -38,6 +80,8 @@ struct Tile
 
   /**
    * @brief Overloaded input stream operator for reading Tile objects.
+   * A prompt for each coordinate is written to the stream tied to is, e.g. std::cout for std::cin;
+   * an untied stream, such as a file or string stream, is read without prompts.
    * @param is The input stream.
    * @param t The Tile object to store the read values.
    * @return The input stream after reading the Tile object.
@@ -69,13 +113,33 @@ struct Tile
   friend bool operator>(const Tile &a, const Tile &b);
 };
 
+// The comparisons use the coordinates rather than Key(), so they stay exact outside the key range.
+// The order is the one of the keys: z, then y, then x.
+inline bool operator==(const Tile &a, const Tile &b)
+{
+  return a.y == b.y && a.x == b.x && a.z == b.z;
+}
+
+inline bool operator<(const Tile &a, const Tile &b)
+{
+  if (a.z != b.z)
+    return a.z < b.z;
+  if (a.y != b.y)
+    return a.y < b.y;
+  return a.x < b.x;
+}
+
+inline bool operator>(const Tile &a, const Tile &b)
+{
+  return b < a;
+}
+
 /**
  * @struct HalfEdge
  * @brief Represents a half-edge in the graph.
  */
 struct HalfEdge
 {
-  HalfEdge *next_edge;
   int32_t vertex_index;
   uint16_t weight;
 };
@@ -83,25 +147,390 @@ struct HalfEdge
 /**
  * @struct Vertex
  * @brief Represents a vertex in the graph.
+ *
+ * The tile of the vertex is not stored here: the graph keeps tiles in per-axis
+ * columns indexed like its vertices, see graph::GetTile.
+ *
+ * A maze tile has at most four lateral neighbours plus a ramp, so the half-edges are
+ * stored inline, in insertion order. Only a vertex with more than kInlineEdges
+ * neighbours moves all of them to the overflow vector.
  */
 struct Vertex
+{
+  static constexpr int32_t kInlineEdges = 5;
+
+  HalfEdge inline_edges[kInlineEdges];
+  int32_t degree;
+  std::vector<HalfEdge> overflow;
+
+  /**
+   * @brief Constructs a Vertex object with no half-edges.
+   */
+  Vertex();
+
+  /**
+   * @brief Returns the half-edges of the vertex, stored contiguously.
+   * @return A pointer to the first of degree half-edges.
+   */
+  HalfEdge *Edges() { return degree > kInlineEdges ? overflow.data() : inline_edges; }
+  const HalfEdge *Edges() const { return degree > kInlineEdges ? overflow.data() : inline_edges; }
+};
+
+/**
+ * @struct EdgeView
+ * @brief Lightweight view of a half-edge: the index of the neighbour and the weight of the edge.
+ */
+struct EdgeView
+{
+  int32_t vertex_index;
+  uint16_t weight;
+};
+
+/**
+ * @class NeighbourRange
+ * @brief Range over the half-edges leaving a vertex, iterated without copies or allocations.
+ *
+ * Half-edges are visited from the most recently added one. The range is invalidated
+ * by any change to the adjacency list it walks.
+ */
+class NeighbourRange
+{
+private:
+  const HalfEdge *edges_;
+  int32_t count_;
+
+public:
+  /**
+   * @class iterator
+   * @brief Forward iterator yielding an EdgeView for each half-edge.
+   */
+  class iterator
+  {
+  private:
+    const HalfEdge *edges_;
+    int32_t position_;
+
+  public:
+    iterator(const HalfEdge *edges, int32_t position) : edges_(edges), position_(position) {}
+    EdgeView operator*() const { return {edges_[position_].vertex_index, edges_[position_].weight}; }
+    iterator &operator++()
+    {
+      position_--;
+      return *this;
+    }
+    bool operator==(const iterator &other) const { return position_ == other.position_; }
+    bool operator!=(const iterator &other) const { return position_ != other.position_; }
+  };
+
+  /**
+   * @brief Constructs a range over an array of half-edges.
+   * @param edges The half-edges of the vertex.
+   * @param count The number of half-edges.
+   */
+  NeighbourRange(const HalfEdge *edges, int32_t count) : edges_(edges), count_(count) {}
+
+  iterator begin() const { return iterator(edges_, count_ - 1); }
+  iterator end() const { return iterator(edges_, -1); }
+
+  /**
+   * @brief Checks whether the vertex has no neighbours.
+   * @return True if the range is empty, false otherwise.
+   */
+  bool empty() const { return count_ == 0; }
+};
+
+/**
+ * @struct TileDistDirection
+ * @brief Entry of the A* open set: a tile, its tentative distance and the direction the robot faces on it.
+ */
+struct TileDistDirection
 {
   Tile tile;
-  HalfEdge *adjacency_list;
+  double distance;
+  int direction;
+};
+
+/**
+ * @struct TileKeyHasher
+ * @brief Hash functor for packed tile keys.
+ *
+ * Applies the splitmix64 finalizer, so neighbouring tiles, whose keys differ in a few low bits, spread over the whole table.
+ */
+struct TileKeyHasher
+{
+  std::size_t operator()(uint64_t key) const
+  {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key;
+  }
+};
+
+/**
+ * @struct TileHasher
+ * @brief Hash functor for using Tile objects as keys of unordered containers.
+ */
+struct TileHasher
+{
+  std::size_t operator()(const Tile &tile) const
+  {
+    return TileKeyHasher{}(tile.Key());
+  }
+};
+
+/**
+ * @struct CompareDist
+ * @brief Comparator turning std::priority_queue into a min-heap on TileDistDirection::distance.
+ */
+struct CompareDist
+{
+  bool operator()(const TileDistDirection &a, const TileDistDirection &b)
+  {
+    return a.distance > b.distance; // Ordine crescente in base alla distanza
+  }
+};
+
+/**
+ * @struct CostPolicy
+ * @brief Cost model of the path searches: the cost of one move given the heading, and a lower bound for heuristics.
+ *
+ * Directions are 0 (+y), 1 (+x), 2 (-y) and 3 (-x). A lateral move turns the robot towards the direction
+ * of the move, a move between floors (a ramp) keeps its heading. The members are plain values, so a
+ * policy can be tuned per arena at run time, and the step cost is inline so it is compiled into the
+ * expansion loops. The defaults reproduce the historical costs: edge weight, 2 per quarter turn, 4 to turn around.
+ */
+struct CostPolicy
+{
+  int32_t move = 0;         ///< Added to every move.
+  int32_t weight_scale = 1; ///< Multiplies the edge weight, which encodes the type of the tile.
+  int32_t quarter_turn = 2; ///< Added to a lateral move to the left or to the right of the heading.
+  int32_t turn_around = 4;  ///< Added to a lateral move opposite to the heading.
+  int32_t floor_change = 0; ///< Added to every move between floors.
+
+  /**
+   * @brief Returns the part of the cost of one move that does not depend on the heading.
+   * @param from The tile the move starts from.
+   * @param to The tile the move ends on.
+   * @param weight The weight of the half-edge from from to to.
+   * @return The cost of the move, without the turn.
+   */
+  int32_t MoveCost(const Tile &from, const Tile &to, uint16_t weight) const
+  {
+    return move + weight_scale * weight + (to.z != from.z ? floor_change : 0);
+  }
+
+  /**
+   * @brief Returns the cost of one move.
+   * @param from The tile the move starts from.
+   * @param direction The direction the robot faces on from.
+   * @param to The tile the move ends on.
+   * @param weight The weight of the half-edge from from to to.
+   * @param new_direction Set to the direction the robot faces on to.
+   * @return The cost of the move.
+   */
+  int32_t StepCost(const Tile &from, int direction, const Tile &to, uint16_t weight, int &new_direction) const
+  {
+    int32_t cost = MoveCost(from, to, weight);
+    int32_t dy = to.y - from.y;
+    int32_t dx = to.x - from.x;
+    new_direction = direction;
+    if ((dy != 0) != (dx != 0))
+    {
+      int move_direction = dy > 0 ? 0 : dx > 0 ? 1 : dy < 0 ? 2 : 3;
+      int turn = (move_direction - direction + 4) % 4;
+      cost += turn == 2 ? turn_around : turn != 0 ? quarter_turn : 0;
+      new_direction = move_direction;
+    }
+    return cost;
+  }
+
+  /**
+   * @brief Returns a lower bound of the cost of any path between two tiles, assuming non-negative costs.
+   *
+   * Every move covers at most max_span of the distance |dy| + |dx| + |dz| and costs at least move plus the
+   * scaled minimum weight; the floors are crossed by moves between floors, which also add floor_change.
+   * One move lowers the bound by at most its cost, so the bound is a consistent A* heuristic.
+   * @param from The first tile.
+   * @param to The second tile.
+   * @param min_weight A lower bound of the edge weights.
+   * @param max_span An upper bound of |dy| + |dx| + |dz| between the tiles of an edge, at least 1.
+   * @return The lower bound.
+   */
+  int32_t LowerBound(const Tile &from, const Tile &to, uint16_t min_weight, int32_t max_span) const
+  {
+    int32_t floors = std::abs(to.z - from.z);
+    int32_t distance = std::abs(to.y - from.y) + std::abs(to.x - from.x) + floors;
+    int32_t moves = (distance + max_span - 1) / max_span;
+    int32_t floor_moves = (floors + max_span - 1) / max_span;
+    return moves * std::max(move + weight_scale * min_weight, 0) + floor_moves * std::max(floor_change, 0);
+  }
+};
+
+/**
+ * @struct EdgeWeightUpdate
+ * @brief New weight for the edge between two tiles, as consumed by graph::ApplyEdgeWeights.
+ */
+struct EdgeWeightUpdate
+{
+  Tile from;
+  Tile to;
+  uint16_t weight;
+};
+
+/**
+ * @struct EdgeChange
+ * @brief A half-edge whose weight was changed by a batched mutation.
+ */
+struct EdgeChange
+{
+  int32_t from;
+  int32_t to;
+  uint16_t old_weight;
+  uint16_t new_weight;
+};
+
+/**
+ * @struct ChangeSet
+ * @brief Consolidated description of what a batched mutation changed, for planners and caches to consume.
+ */
+struct ChangeSet
+{
+  std::vector<EdgeChange> edges;  ///< Every half-edge whose weight changed, once.
+  std::vector<int32_t> vertices;  ///< Indices of the vertices owning a changed, added or removed half-edge, sorted and unique.
+  std::vector<int32_t> added_vertices;                    ///< Indices of the vertices added by the batch.
+  std::vector<std::pair<int32_t, int32_t>> added_edges;   ///< Edges added by the batch, as (low, high) vertex indices.
+  std::vector<std::pair<int32_t, int32_t>> removed_edges; ///< Edges removed by the batch, as (low, high) vertex indices.
+  std::vector<int32_t> removed_vertices;                  ///< Indices of the vertices removed by the batch.
+  uint64_t version = 0;           ///< Graph version after the batch was applied.
+
+  /**
+   * @brief Empties the change set.
+   */
+  void Clear();
 
   /**
-   * @brief Constructs a Vertex object with the given tile and adjacency list.
-   * @param t The tile associated with the vertex.
-   * @param adjacency_list The adjacency list of the vertex.
-   * @param visited Flag indicating if the vertex has been visited during graph traversal.
+   * @brief Adds the changes of a later batch, so the change set describes both batches.
+   * A half-edge changed by both keeps its first old weight and its last new weight, and is dropped if they are equal.
+   * @param later The changes applied after the ones of this change set.
    */
-  Vertex(Tile t, HalfEdge *adjacency_list, bool visited);
+  void Append(const ChangeSet &later);
 
   /**
-   * @brief Constructs a Vertex object with the given tile.
-   * @param t The tile associated with the vertex.
+   * @brief Checks whether the batch changed anything.
+   * @return True if nothing changed, false otherwise.
    */
-  Vertex(Tile t);
+  bool empty() const { return edges.empty() && added_vertices.empty() && added_edges.empty() && removed_edges.empty() && removed_vertices.empty(); }
+};
+
+/**
+ * @struct GraphStatistics
+ * @brief Graph-wide counters, maintained incrementally by the graph.
+ */
+struct GraphStatistics
+{
+  int32_t num_vertices = 0;
+  int32_t num_edges = 0;
+  uint64_t total_weight = 0;                              ///< Sum of the weights of all half-edges, so an edge counts once per direction.
+  std::vector<int32_t> degree_histogram;                  ///< Number of vertices for each degree.
+  std::vector<std::pair<int32_t, int32_t>> floor_vertices; ///< Number of vertices of each floor, as (z, count) sorted by z.
+};
+
+/**
+ * @brief Weight function applied by the batched tile updates: receives the tile and the current weight of one of its edges, returns the new weight.
+ */
+using TileWeightFunction = std::function<uint16_t(const Tile &, uint16_t)>;
+
+/**
+ * @struct VertexHandle
+ * @brief Stable reference to a vertex: unlike its index, it survives graph::Compact.
+ *
+ * A handle is a slot plus the generation of the slot, so it becomes invalid, rather
+ * than pointing at another vertex, once its vertex is removed and the slot reused.
+ */
+struct VertexHandle
+{
+  uint32_t slot = UINT32_MAX;
+  uint32_t generation = 0;
+};
+
+inline bool operator==(const VertexHandle &a, const VertexHandle &b)
+{
+  return a.slot == b.slot && a.generation == b.generation;
+}
+
+/**
+ * @struct TileEdge
+ * @brief An edge between two tiles, as consumed by graph::Build.
+ */
+struct TileEdge
+{
+  Tile from;
+  Tile to;
+  uint16_t weight;
+};
+
+/**
+ * @brief Bits of a wall map cell. Wall bits follow the direction numbering used by the search: 0 (+y), 1 (+x), 2 (-y), 3 (-x).
+ */
+constexpr uint8_t kWallNorth = 1 << 0;
+constexpr uint8_t kWallEast = 1 << 1;
+constexpr uint8_t kWallSouth = 1 << 2;
+constexpr uint8_t kWallWest = 1 << 3;
+constexpr uint8_t kTileKnown = 1 << 4;
+
+/**
+ * @struct FloorWallMap
+ * @brief Wall bitmap of one floor, as consumed by graph::BuildFromWallMaps.
+ *
+ * Cells are stored row by row, cell (row, column) being the tile {origin_y + row, origin_x + column, z}.
+ * A cell is a tile only if its kTileKnown bit is set. Two neighbouring tiles are connected unless
+ * either of them has a wall on the shared side.
+ */
+struct FloorWallMap
+{
+  int32_t z;
+  int32_t origin_y, origin_x;
+  int32_t height, width;
+  std::vector<uint8_t> cells;
+};
+
+/**
+ * @struct TileObservation
+ * @brief What the mapper observed on one tile, as consumed by graph::ApplyObservations.
+ */
+struct TileObservation
+{
+  Tile tile;
+  uint8_t walls;   ///< kWall* bits of the sides with a wall.
+  uint16_t weight; ///< Weight of the half-edges leaving the tile.
+};
+
+/**
+ * @enum ManeuverType
+ * @brief Command of a Maneuver.
+ */
+enum class ManeuverType : uint8_t
+{
+  Forward,    ///< Move ahead by count tiles on the same floor.
+  TurnLeft,   ///< Turn a quarter counterclockwise, e.g. from +y to -x.
+  TurnRight,  ///< Turn a quarter clockwise, e.g. from +y to +x.
+  TurnAround, ///< Turn by half a revolution.
+  RampUp,     ///< Move by count tiles, each one floor up.
+  RampDown    ///< Move by count tiles, each one floor down.
+};
+
+/**
+ * @struct Maneuver
+ * @brief One command of a path, as produced by graph::GetManeuvers.
+ */
+struct Maneuver
+{
+  ManeuverType type;
+  int32_t count; ///< Number of tiles moved, 1 for turns.
+  int32_t cost;  ///< Share of the CostPolicy cost of the path; the costs of a path's maneuvers add up to its length.
 };
 
 /**
@@ -113,6 +542,127 @@ class graph
 private:
   std::vector<Vertex> graph_;
 
+  // Bumped by every mutation, so derived data can tell whether it is stale.
+  uint64_t version_;
+
+  // Tiles of the vertices as a structure of arrays, indexed like graph_,
+  // so bulk scans over one axis are contiguous and vectorisable.
+  std::vector<int32_t> tile_y_;
+  std::vector<int32_t> tile_x_;
+  std::vector<int32_t> tile_z_;
+
+  // Packed tile key to vertex index.
+  std::unordered_map<uint64_t, int32_t, TileKeyHasher> index_;
+
+  // Spatial index: each floor is split in square cells of 2^kSpatialCellBits tiles per side.
+  static constexpr int kSpatialCellBits = 3;
+
+  /**
+   * @struct FloorIndex
+   * @brief Vertices of one floor and the range of cells they occupy.
+   */
+  struct FloorIndex
+  {
+    std::vector<int32_t> vertices;
+    int32_t min_cell_y, max_cell_y;
+    int32_t min_cell_x, max_cell_x;
+  };
+  std::unordered_map<int32_t, FloorIndex> floors_;
+
+  // Packed key of Tile{cell_y, cell_x, z} to the vertices lying in that cell.
+  std::unordered_map<uint64_t, std::vector<int32_t>, TileKeyHasher> cells_;
+
+  void AddToSpatialIndex(int32_t index);
+  void RemoveFromSpatialIndex(int32_t index);
+  int32_t InsertVertex(const Tile &t);
+
+  // Removed vertices keep their index, marked dead, until Compact renumbers the live ones.
+  std::vector<uint8_t> alive_;
+  int32_t num_removed_;
+
+  // Handle slots: slot to vertex index (-1 for a free slot), generation of each slot,
+  // free slots to reuse, and vertex index to slot.
+  std::vector<int32_t> slot_index_;
+  std::vector<uint32_t> slot_generation_;
+  std::vector<uint32_t> free_slots_;
+  std::vector<uint32_t> index_slot_;
+
+  // Connectivity index: union-find forest over the vertex indices, with union by size
+  // and path halving. Adding edges merges components in place; removing an edge may
+  // split one, so the forest is marked dirty and rebuilt by the next query.
+  mutable std::vector<int32_t> component_parent_;
+  mutable std::vector<int32_t> component_size_;
+  mutable int32_t num_components_;
+  mutable bool components_dirty_;
+
+  int32_t FindComponent(int32_t index) const;
+  void UniteComponents(int32_t index1, int32_t index2) const;
+  void RebuildComponents() const;
+
+  // Cut vertices and bridges, recomputed by an iterative Tarjan pass on the first
+  // query after the graph version changes.
+  mutable std::vector<uint8_t> cut_vertex_;
+  mutable std::unordered_set<uint64_t, TileKeyHasher> bridges_;
+  mutable uint64_t cut_version_;
+  mutable bool cut_valid_;
+
+  void UpdateCutAnalysis() const;
+
+  /**
+   * @struct CachedPath
+   * @brief Result of FindPathAStar, valid while version matches the graph version.
+   */
+  struct CachedPath
+  {
+    uint64_t key;                  ///< Start index, goal index and heading packed by PathCacheKey.
+    uint64_t version;              ///< Graph version the path is known to be valid for.
+    uint64_t last_used;            ///< Tick of the last hit, for least recently used eviction.
+    std::vector<int32_t> vertices; ///< Vertex indices of the path, empty if no path was found.
+    int len;
+  };
+  std::vector<CachedPath> path_cache_;
+  size_t path_cache_capacity_;
+  uint64_t path_cache_tick_;
+  bool path_cache_fine_grained_;
+
+  void RevalidatePathCache(const std::vector<uint64_t> &costlier_edges, bool cheaper);
+  void RevalidatePathCache(int32_t index1, int32_t index2, bool cheaper);
+
+  CostPolicy cost_policy_;
+
+  /**
+   * @struct HeuristicTable
+   * @brief Backward distances to one goal, valid while version matches the graph version.
+   */
+  struct HeuristicTable
+  {
+    int32_t goal;
+    uint64_t version;
+    uint64_t last_used;
+    std::shared_ptr<std::vector<int32_t>> distance; // Shared with the searches holding it, so it is never written in place while held.
+  };
+  static constexpr size_t kHeuristicTables = 4;
+  mutable std::vector<HeuristicTable> heuristic_tables_;
+  mutable uint64_t heuristic_tick_;
+
+  // Edge bounds of the heuristic used without a table, recomputed by a scan of the
+  // half-edges on the first query after the graph version changes.
+  mutable uint16_t min_weight_;
+  mutable int32_t max_span_;
+  mutable uint64_t edge_bounds_version_;
+  mutable bool edge_bounds_valid_;
+
+  // Counters maintained by every mutation; per-vertex degrees are kept in Vertex.
+  int32_t num_edges_;
+  uint64_t total_weight_;
+  std::vector<int32_t> degree_histogram_;
+
+  void MoveDegree(int32_t old_degree, int32_t new_degree);
+
+  void ApplyVertexWeights(const std::vector<int32_t> &indices, const TileWeightFunction &weight, ChangeSet &changes);
+  void FinishChangeSet(ChangeSet &changes);
+  void FindPathAStarCached(const Tile &start, const Tile &goal, std::vector<Tile> &path, int &len, int const direction, std::vector<Maneuver> *maneuvers);
+
 public:
   /**
    * @brief Default constructor for the graph class.
@@ -129,10 +679,37 @@ public:
    * @param tile The tile associated with the new vertex.
    * @return True if the vertex is successfully
 
-    added, false if it already exists.
+    added, false if it already exists or is not Tile::InKeyRange().
    */
   bool AddVertex(Tile tile);
 
+  /**
+   * @brief Replaces the content of the graph with the given tiles and edges.
+   *
+   * Runs in O(V + E): every tile and edge is resolved once through the tile index.
+   * Repeated tiles, repeated edges (in either direction), self loops and edges naming
+   * a missing tile are skipped. Edges are inserted in input order, so the result is the
+   * same as calling AddVertex and AddEdge in sequence.
+   * @param tiles The tiles of the vertices.
+   * @param edges The edges between the tiles.
+   * @return The number of edges added.
+   */
+  int Build(const std::vector<Tile> &tiles, const std::vector<TileEdge> &edges);
+
+  /**
+   * @brief Replaces the content of the graph with the tiles of per-floor wall bitmaps.
+   * @param floors The wall bitmap of each floor.
+   * @param ramps Edges connecting tiles of different floors.
+   * @param weight The weight of the edges between neighbouring tiles of a floor.
+   * @return The number of edges added, ramps included.
+   */
+  int BuildFromWallMaps(const std::vector<FloorWallMap> &floors, const std::vector<TileEdge> &ramps, uint16_t weight = 1);
+
+  /**
+   * @brief Removes all the vertices and edges from the graph.
+   */
+  void Clear();
+
   /**
    * @brief Adds an edge between two vertices in the graph.
    * @param from The tile associated with the source vertex.
@@ -178,25 +755,126 @@ public:
    */
   bool RemoveTileAdjacencyList(Tile tile);  
 
+  /**
+   * @brief Removes a vertex and its edges from the graph.
+   * The vertex keeps its index, marked as removed, until Compact is called; handles to it become invalid at once.
+   * @param tile The tile associated with the vertex to remove.
+   * @return True if the vertex is successfully removed, false if the tile is not found.
+   */
+  bool RemoveVertex(const Tile &tile);
+
+  /**
+   * @brief Drops removed vertices from memory, renumbering the live ones in one pass.
+   * The relative order of the live vertices is kept. Vertex indices held by the caller become stale,
+   * handles stay valid.
+   * @return The number of removed vertices that were dropped.
+   */
+  int32_t Compact();
+
+  /**
+   * @brief Returns the number of removed vertices still waiting for Compact.
+   * @return The number of removed vertices.
+   */
+  int32_t NumRemovedVertices() const;
+
+  /**
+   * @brief Checks whether the vertex at an index was removed.
+   * @param index The index of the vertex, lower than NumVertexSlots.
+   * @return True if the vertex was removed, false otherwise.
+   */
+  bool IsRemoved(int32_t index) const;
+
+  /**
+   * @brief Changes the weight of many edges in one pass.
+   * Every update sets both half-edges, like ChangeTileWeight. Updates naming a missing vertex or edge are skipped.
+   * @param updates The edges to update and their new weights.
+   * @param changes Filled with the half-edges whose weight actually changed.
+   * @return The number of updates that named an existing edge.
+   */
+  int ApplyEdgeWeights(const std::vector<EdgeWeightUpdate> &updates, ChangeSet &changes);
+
+  /**
+   * @brief Applies a weight function to the adjacency lists of a set of tiles in one pass.
+   * Like ChangeTileAdjacencyListWeight, only the half-edges leaving each tile are changed. Repeated tiles are updated once.
+   * @param tiles The tiles to update, tiles not in the graph are skipped.
+   * @param weight The function computing the new weight of each half-edge.
+   * @param changes Filled with the half-edges whose weight actually changed.
+   * @return The number of distinct tiles found in the graph.
+   */
+  int ApplyTileWeights(const std::vector<Tile> &tiles, const TileWeightFunction &weight, ChangeSet &changes);
+
+  /**
+   * @brief Applies a weight function to the adjacency lists of all the tiles inside a box.
+   * @param min The minimum corner of the box, inclusive.
+   * @param max The maximum corner of the box, inclusive.
+   * @param weight The function computing the new weight of each half-edge.
+   * @param changes Filled with the half-edges whose weight actually changed.
+   * @return The number of tiles inside the box.
+   */
+  int ApplyRegionWeights(const Tile &min, const Tile &max, const TileWeightFunction &weight, ChangeSet &changes);
+
+  /**
+   * @brief Applies a batch of tile observations in one pass.
+   *
+   * Observations are coalesced per tile, the last one winning. Unknown tiles are added; then each side of an
+   * observed tile is connected to the lateral neighbour on that side if the neighbour is in the graph and neither
+   * tile reports a wall there, and disconnected otherwise. The half-edges leaving an observed tile take its weight,
+   * a new edge towards a tile not observed in the batch takes the same weight both ways. Ramps are left untouched.
+   * The version is bumped once for the whole batch.
+   * @param observations The observations, in the order they were made.
+   * @param changes Filled with the vertices and edges added, the edges removed and the half-edges whose weight changed.
+   * @return The number of distinct tiles observed and applied; tiles that are not Tile::InKeyRange() are ignored.
+   */
+  int ApplyObservations(const std::vector<TileObservation> &observations, ChangeSet &changes);
+
+  /**
+   * @brief Returns the modification counter of the graph.
+   * The counter grows with every successful mutation, so a value saved earlier tells whether derived data is stale.
+   * @return The current version.
+   */
+  uint64_t Version() const;
+
   /**
    * @brief Returns the number of vertices in the graph.
-   * @return The number of vertices in the graph.
+   * @return The number of vertices in the graph, removed vertices excluded.
+   */
+  int NumVertices() const;
+
+  /**
+   * @brief Returns one past the largest vertex index, to size arrays indexed by vertex.
+   * @return The number of vertices in the graph, removed vertices not yet compacted included.
    */
-  int NumVertices();
+  int32_t NumVertexSlots() const;
 
   /**
-   * @brief Returns the number of edges in the graph.
+   * @brief Returns the number of edges in the graph, in O(1).
    * @return The number of edges in the graph.
    */
-  int NumEdges();
+  int NumEdges() const;
 
   /**
-   * @brief Calculates the degree of a given vertex in the graph.
+   * @brief Calculates the degree of a given vertex in the graph, in O(1).
    * @param tile The tile associated with the vertex.
-   * @param degree The calculated degree of the vertex.
+   * @param degree The calculated degree of the vertex, added to the passed value.
    * @return True if the vertex exists and the degree is calculated successfully, false otherwise.
    */
-  bool NodeDegree(Tile tile, int &degree);
+  bool NodeDegree(Tile tile, int &degree) const;
+
+  /**
+   * @brief Copies the graph-wide counters. The cost depends only on the number of floors and distinct degrees.
+   * @param stats The structure to fill.
+   */
+  void GetStatistics(GraphStatistics &stats) const;
+
+  /**
+   * @brief Checks the internal consistency of the graph, for differential testing and debugging.
+   *
+   * Verifies that every half-edge has a reverse, targets a live vertex other than its source and is
+   * not duplicated, that dead vertices have no edges, and that the counters, the tile index, the
+   * spatial index and the handle slots agree with the adjacency. The cost is linear in the size of the graph.
+   * @return True if every check passes, false otherwise.
+   */
+  bool CheckInvariants() const;
 
   /**
    * @brief Checks if two vertices are adjacent (connected by an edge) in the graph.
@@ -206,6 +884,50 @@ public:
    */
   bool AreAdjacent(Tile tile1, Tile tile2);
 
+  /**
+   * @brief Checks whether two vertices lie in the same connected component.
+   * Runs in near constant time, except for the first query after an edge removal, which rebuilds the index in O(V + E).
+   * @param tile1 The tile associated with the first vertex.
+   * @param tile2 The tile associated with the second vertex.
+   * @return True if a path connects the vertices, false otherwise or if a tile is not found.
+   */
+  bool AreConnected(const Tile &tile1, const Tile &tile2) const;
+
+  /**
+   * @brief Returns the number of connected components of the graph.
+   * @return The number of connected components, isolated vertices included.
+   */
+  int32_t NumComponents() const;
+
+  /**
+   * @brief Checks whether removing a vertex would disconnect its component.
+   * The analysis runs in O(V + E) on the first query after a change, later queries are O(1).
+   * @param tile The tile associated with the vertex.
+   * @return True if the vertex is an articulation point, false otherwise or if the tile is not found.
+   */
+  bool IsCutVertex(const Tile &tile) const;
+
+  /**
+   * @brief Checks whether removing an edge would disconnect its component.
+   * The analysis runs in O(V + E) on the first query after a change, later queries are O(1).
+   * @param tile1 The tile associated with the first vertex.
+   * @param tile2 The tile associated with the second vertex.
+   * @return True if the edge exists and is a bridge, false otherwise.
+   */
+  bool IsBridge(const Tile &tile1, const Tile &tile2) const;
+
+  /**
+   * @brief Collects the articulation points of the graph.
+   * @param tiles The vector the tiles of the cut vertices are appended to, in vertex order.
+   */
+  void GetCutVertices(std::vector<Tile> &tiles) const;
+
+  /**
+   * @brief Collects the bridges of the graph.
+   * @param bridges The vector the bridges are appended to, as pairs of tiles.
+   */
+  void GetBridges(std::vector<std::pair<Tile, Tile>> &bridges) const;
+
   /**
    * @brief Returns the adjacency list of a vertex as a vector of tiles.
    * @param tile The tile associated with the vertex.
@@ -225,19 +947,115 @@ public:
    * @param tile The tile associated with the vertex.
    * @return The index of the tile in the graph vector, or -1 if not found.
    */
-  int32_t GetNode(const Tile &tile);
+  int32_t GetNode(const Tile &tile) const;
+
+  /**
+   * @brief Returns the index of the vertex a handle refers to.
+   * @param handle The handle of the vertex.
+   * @return The current index of the vertex, or -1 if the handle is invalid or its vertex was removed.
+   */
+  int32_t GetNode(const VertexHandle &handle) const;
+
+  /**
+   * @brief Returns a stable handle to the vertex of a tile.
+   * @param tile The tile associated with the vertex.
+   * @return The handle of the vertex, or a default (invalid) handle if the tile is not found.
+   */
+  VertexHandle GetHandle(const Tile &tile) const;
+
+  /**
+   * @brief Returns the tile of the vertex at the given index.
+   * @param index The index of the vertex, as returned by GetNode.
+   * @return The tile associated with the vertex.
+   */
+  Tile GetTile(int32_t index) const;
+
+  /**
+   * @brief Computes the bounding box of all the tiles in the graph.
+   * @param min The tile holding the minimum coordinate of each axis.
+   * @param max The tile holding the maximum coordinate of each axis.
+   * @return True if the graph has at least one vertex, false otherwise.
+   */
+  bool GetBoundingBox(Tile &min, Tile &max) const;
+
+  /**
+   * @brief Computes the bounding box of the tiles on one floor.
+   * @param z The floor.
+   * @param min The tile holding the minimum coordinates of the floor.
+   * @param max The tile holding the maximum coordinates of the floor.
+   * @return True if the floor has at least one vertex, false otherwise.
+   */
+  bool GetFloorBoundingBox(int32_t z, Tile &min, Tile &max) const;
+
+  /**
+   * @brief Counts the tiles on one floor.
+   * @param z The floor.
+   * @return The number of vertices whose tile lies on the floor.
+   */
+  int32_t CountFloorTiles(int32_t z) const;
+
+  /**
+   * @brief Finds the known tile closest to a coordinate on the same floor.
+   * The coordinate does not need to match a vertex; distance is Euclidean on the y-x plane.
+   * @param query The coordinate to look up.
+   * @param nearest The closest tile on floor query.z.
+   * @return True if the floor has at least one vertex, false otherwise.
+   */
+  bool FindNearestTile(const Tile &query, Tile &nearest) const;
+
+  /**
+   * @brief Collects the indices of the vertices inside a box.
+   * @param min The minimum corner of the box, inclusive.
+   * @param max The maximum corner of the box, inclusive.
+   * @param indices The vector the vertex indices are appended to.
+   */
+  void GetVerticesInBox(const Tile &min, const Tile &max, std::vector<int32_t> &indices) const;
+
+  /**
+   * @brief Collects the tiles inside a box.
+   * @param min The minimum corner of the box, inclusive.
+   * @param max The maximum corner of the box, inclusive.
+   * @param tiles The vector the tiles are appended to.
+   */
+  void GetTilesInBox(const Tile &min, const Tile &max, std::vector<Tile> &tiles) const;
+
+  /**
+   * @brief Collects the tiles of one floor.
+   * @param z The floor.
+   * @param tiles The vector the tiles are appended to, in insertion order.
+   */
+  void GetFloorTiles(int32_t z, std::vector<Tile> &tiles) const;
+
+  /**
+   * @brief Returns the neighbours of a vertex as a view over its adjacency list.
+   * @param index The index of the vertex, as returned by GetNode.
+   * @return The range of the half-edges leaving the vertex.
+   */
+  NeighbourRange Neighbours(int32_t index) const;
+
+  /**
+   * @brief Returns the neighbours of a vertex as a view over its adjacency list.
+   * @param tile The tile associated with the vertex.
+   * @return The range of the half-edges leaving the vertex, empty if the tile is not found.
+   */
+  NeighbourRange Neighbours(const Tile &tile) const;
 
   /**
    * @brief Finds a path between two vertices in the graph using Depth-First Search (DFS) algorithm.
+   * The path is not the shortest one: the search is iterative, visits each vertex at most once and
+   * tries the neighbour straight ahead first, for a cheap "any path" when latency matters more than cost.
    * @param start The tile associated with the start vertex.
    * @param goal The tile associated with the goal vertex.
    * @param path The vector to store the tiles of the found path.
-   * @param len The length of the found path.
+   * @param len The sum of the edge weights along the found path, or -1 if no path was found.
    */
   void FindPathDFS(Tile start, Tile goal, std::vector<Tile> &path, int &len);
 
   /**
    * @brief Finds a path between two vertices in the graph using the A* algorithm.
+   *
+   * The heuristic is the cached table of the goal if GetHeuristicTable computed one for the current
+   * graph version, and CostPolicy::LowerBound otherwise, so a query never runs a full backward Dijkstra.
    * @param start The tile associated with the start vertex.
    * @param goal The tile associated with the goal vertex.
    * @param path The vector to store the tiles of the found path.
@@ -246,25 +1064,254 @@ public:
    */
   void FindPathAStar(const Tile &start, const Tile &goal, std::vector<Tile> &path, int &len, int const direction);
 
+  /**
+   * @brief Finds a path with FindPathAStar, also as maneuvers.
+   *
+   * The maneuvers are built while the path is reconstructed from the search states, as by AStarSearch::GetPath;
+   * only a path answered from the cache goes through GetManeuvers.
+   * @param start The tile associated with the start vertex.
+   * @param goal The tile associated with the goal vertex.
+   * @param path The vector to store the tiles of the found path.
+   * @param len The length of the found path.
+   * @param direction The direction of the search.
+   * @param maneuvers The vector to store the maneuvers of the found path, cleared if no path was found.
+   */
+  void FindPathAStar(const Tile &start, const Tile &goal, std::vector<Tile> &path, int &len, int const direction, std::vector<Maneuver> &maneuvers);
+
+  /**
+   * @brief Converts a path to maneuvers, merging straight moves on a floor into one Forward.
+   *
+   * A step that changes direction becomes a turn followed by the move; the turn carries the turn
+   * cost and the move the rest of the step cost, so the maneuver costs add up to the path length.
+   * @param path The tiles of the path, each adjacent to the next.
+   * @param direction The direction the robot faces on the first tile.
+   * @param maneuvers The vector to store the maneuvers.
+   * @return True if the path is valid, false if two consecutive tiles are not adjacent.
+   */
+  bool GetManeuvers(const std::vector<Tile> &path, int direction, std::vector<Maneuver> &maneuvers) const;
+
+  /**
+   * @brief Finds a cheapest path with a plain Dijkstra over (vertex, heading) states, as a reference for the faster searches.
+   *
+   * Unlike FindPathAStar, which keeps one distance per vertex, it tracks the heading in the state,
+   * so the result is exact under the CostPolicy, at four times the state space and with no caching.
+   * @param start The tile associated with the start vertex.
+   * @param goal The tile associated with the goal vertex.
+   * @param path The vector to store the tiles of the found path.
+   * @param len The CostPolicy cost of the found path, or -1 if no path was found.
+   * @param direction The direction the robot faces on the start tile.
+   */
+  void FindPathReference(const Tile &start, const Tile &goal, std::vector<Tile> &path, int &len, int const direction) const;
+
+  /**
+   * @brief Sets the cost model of the path searches. Bumps the version, since every path cost may change.
+   * @param policy The new cost model.
+   */
+  void SetCostPolicy(const CostPolicy &policy);
+
+  /**
+   * @brief Returns the cost model of the path searches.
+   * @return The current cost model.
+   */
+  const CostPolicy &GetCostPolicy() const;
+
+  /**
+   * @brief Returns lower bounds of the cost of reaching a goal, for use as an A* heuristic.
+   *
+   * The bounds are exact backward distances under the CostPolicy without the turn costs, so they are
+   * consistent as long as the policy costs are not negative. The tables of the last few goals are kept
+   * until the graph version changes, so repeated queries towards the same goal reuse them.
+   * @param goal The tile associated with the goal vertex.
+   * @return The bound for each vertex index, INT32_MAX where the goal cannot be reached; nullptr if the tile is not found.
+   * The table stays valid while it is held, even after the graph changes or the cache evicts it.
+   */
+  std::shared_ptr<const std::vector<int32_t>> GetHeuristicTable(const Tile &goal) const;
+
+  /**
+   * @brief Returns the cached heuristic table of a goal without computing it.
+   * @param goal The tile associated with the goal vertex.
+   * @return The table, or nullptr if GetHeuristicTable has not computed it since the last change of the graph version.
+   */
+  std::shared_ptr<const std::vector<int32_t>> FindHeuristicTable(const Tile &goal) const;
+
+  /**
+   * @brief Returns the bounds of the edges used with CostPolicy::LowerBound when no heuristic table is cached.
+   * They are recomputed on the first call after the graph version changes, in time linear in the size of the graph.
+   * @param min_weight Set to the lowest weight of a half-edge, 0 if there is none.
+   * @param max_span Set to the largest |dy| + |dx| + |dz| between the tiles of an edge, at least 1.
+   */
+  void GetEdgeBounds(uint16_t &min_weight, int32_t &max_span) const;
+
+  /**
+   * @brief Sets how many FindPathAStar results are cached, evicting the least recently used ones.
+   * A cached result is reused while the graph version it was computed for is current. The default capacity is 16.
+   * @param capacity The maximum number of cached paths, 0 disables the cache.
+   */
+  void SetPathCacheCapacity(size_t capacity);
+
+  /**
+   * @brief Enables fine-grained invalidation of the path cache.
+   * When enabled, making an edge costlier or removing it only drops the cached paths that traverse it;
+   * the other paths are kept, since their cost did not change and no alternative got cheaper.
+   * Making an edge cheaper or adding one still drops every cached path. FindPathAStar is exact, so a kept
+   * path has the cost a fresh search would find, though ties may be broken differently.
+   * @param enabled True to enable fine-grained invalidation, false to drop the whole cache on every change.
+   */
+  void SetPathCacheFineGrained(bool enabled);
+
+  /**
+   * @brief Drops every cached path.
+   */
+  void ClearPathCache();
+
   /**
    * @brief Prints the graph.
+   * @param os The output stream to print to.
    */
-  void PrintGraph();
+  void PrintGraph(std::ostream &os = std::cout);
 
   /**
    * @brief Prints the maze.
+   * @param os The output stream to print to.
    */
-  void PrintMaze();
+  void PrintMaze(std::ostream &os = std::cout);
 
   /**
    * @brief Prints the maze.
    * @param current_position The current position in the maze.
+   * @param os The output stream to print to.
    */
-  void PrintMaze(Tile current_position);
+  void PrintMaze(Tile current_position, std::ostream &os = std::cout);
 
   /**
    * @brief Prints the maze path.
    * @param path The path to be printed.
+   * @param os The output stream to print to.
+   */
+  void PrintMazePath(std::vector<Tile> &path, std::ostream &os = std::cout);
+};
+
+/**
+ * @enum SearchStatus
+ * @brief State of a resumable AStarSearch.
+ */
+enum class SearchStatus
+{
+  Idle,     ///< No query has been started.
+  Running,  ///< The query is in progress, call Step() again.
+  Found,    ///< The goal has been reached, the path can be read with GetPath().
+  NotFound  ///< The open set has been exhausted without reaching the goal.
+};
+
+/**
+ * @class AStarSearch
+ * @brief Resumable A* search over a graph.
+ *
+ * The search advances a bounded number of expansions per Step() call, so a single
+ * query can be spread over several iterations of a single-threaded control loop.
+ * The graph must not be modified while a query is Running. States are (vertex, heading) pairs,
+ * so the cost found is the lowest under the CostPolicy, as for graph::FindPathReference.
+ *
+ * Start never computes a heuristic table, so its work is bounded by the size of the graph.
+ * The exact heuristic is opt-in: call graph::GetHeuristicTable(goal) beforehand, e.g. when the
+ * goal is chosen, and Start uses the cached table while the graph version is unchanged;
+ * otherwise the heuristic is CostPolicy::LowerBound with the bounds of graph::GetEdgeBounds.
+ */
+class AStarSearch
+{
+private:
+  const graph &graph_;
+  Tile start_;
+  Tile goal_;
+  SearchStatus status_;
+  int expansions_;
+  int direction_;
+  double len_;
+  int32_t index_start_;
+  int32_t index_goal_;
+  int32_t state_goal_; // State the goal was reached in, -1 until Found.
+
+  /**
+   * @struct OpenNode
+   * @brief Entry of the open set, keyed on state: vertex index * 4 + heading.
+   */
+  struct OpenNode
+  {
+    double priority; ///< Distance from the start plus the heuristic.
+    int32_t state;
+  };
+
+  /**
+   * @struct CompareOpenNode
+   * @brief Comparator turning the open set into a min-heap on OpenNode::priority.
+   */
+  struct CompareOpenNode
+  {
+    bool operator()(const OpenNode &a, const OpenNode &b) const
+    {
+      return a.priority > b.priority;
+    }
+  };
+
+  // Per-state data, indexed by vertex index * 4 + heading. The buffers keep their capacity
+  // between queries so the expansion loop does not allocate.
+  std::vector<double> dist_;
+  std::vector<int32_t> predecessor_;
+  std::vector<uint8_t> closed_nodes_;
+  std::vector<OpenNode> open_nodes_;
+  std::shared_ptr<const std::vector<int32_t>> heuristic_; // From graph::FindHeuristicTable, nullptr for none.
+  const int32_t *heuristic_values_;                      // Data of heuristic_, nullptr for CostPolicy::LowerBound.
+  uint16_t min_weight_;                                  // Edge bounds of CostPolicy::LowerBound, from graph::GetEdgeBounds.
+  int32_t max_span_;
+
+public:
+  /**
+   * @brief Constructs an idle search over the given graph.
+   * @param g The graph to search. It must outlive the search object.
+   */
+  AStarSearch(const graph &g);
+
+  /**
+   * @brief Starts a new query, discarding the state of the previous one.
+   * @param start The tile associated with the start vertex.
+   * @param goal The tile associated with the goal vertex.
+   * @param direction The direction the robot faces on the start tile, 0 to 3; any other value finds no path.
+   */
+  void Start(const Tile &start, const Tile &goal, int const direction);
+
+  /**
+   * @brief Advances the current query.
+   * @param max_expansions The maximum number of nodes to expand in this call, a negative value runs the query to completion.
+   * @return The status of the query after this call.
+   */
+  SearchStatus Step(int max_expansions);
+
+  /**
+   * @brief Returns the status of the current query.
+   * @return The status of the current query.
+   */
+  SearchStatus Status() const;
+
+  /**
+   * @brief Returns the number of nodes expanded so far by the current query.
+   * @return The number of expansions.
+   */
+  int Expansions() const;
+
+  /**
+   * @brief Reads the result of a finished query.
+   * @param path The vector to store the tiles of the found path, cleared if no path was found.
+   * @param len The length of the found path, or -1 if no path was found.
+   * @return True if the query has finished and a path was found, false otherwise.
+   */
+  bool GetPath(std::vector<Tile> &path, int &len);
+
+  /**
+   * @brief Reads the result of a finished query, also as maneuvers, in one walk over the search states.
+   * @param path The vector to store the tiles of the found path, cleared if no path was found.
+   * @param len The length of the found path, or -1 if no path was found.
+   * @param maneuvers The vector to store the maneuvers of the found path, cleared if no path was found.
+   * @return True if the query has finished and a path was found, false otherwise.
    */
-  void PrintMazePath(std::vector<Tile> &path);
+  bool GetPath(std::vector<Tile> &path, int &len, std::vector<Maneuver> &maneuvers);
 };
@@ -0,0 +1,71 @@
+#include "graph_snapshot.h"
+
+graph_snapshot::graph_snapshot(const graph &g) : version_(g.Version()), cost_policy_(g.GetCostPolicy())
+{
+  int32_t n = g.NumVertexSlots();
+  offsets_.reserve(n + 1);
+  tiles_.reserve(n);
+  alive_.reserve(n);
+  offsets_.push_back(0);
+  for (int32_t i = 0; i < n; i++)
+  {
+    tiles_.push_back(g.GetTile(i));
+    for (const EdgeView &edge : g.Neighbours(i))
+    {
+      targets_.push_back(edge.vertex_index);
+      weights_.push_back(edge.weight);
+    }
+    offsets_.push_back(targets_.size());
+    alive_.push_back(!g.IsRemoved(i));
+    if (alive_.back())
+      index_.emplace(tiles_.back().Key(), i);
+  }
+
+  // Edges are undirected, so every half-edge has an opposite one, possibly with another weight.
+  costs_.resize(targets_.size());
+  reverse_costs_.resize(targets_.size());
+  for (int32_t v = 0; v < n; v++)
+  {
+    for (int32_t e = offsets_[v]; e < offsets_[v + 1]; e++)
+    {
+      int32_t u = targets_[e];
+      uint16_t reverse_weight = weights_[e];
+      for (int32_t reverse = offsets_[u]; reverse < offsets_[u + 1]; reverse++)
+      {
+        if (targets_[reverse] == v)
+          reverse_weight = weights_[reverse];
+      }
+      costs_[e] = std::max(cost_policy_.MoveCost(tiles_[v], tiles_[u], weights_[e]), 0);
+      reverse_costs_[e] = std::max(cost_policy_.MoveCost(tiles_[u], tiles_[v], reverse_weight), 0);
+    }
+  }
+}
+
+int32_t graph_snapshot::GetNode(const Tile &tile) const
+{
+  if (!tile.InKeyRange())
+    return -1;
+  auto it = index_.find(tile.Key());
+  return it == index_.end() ? -1 : it->second;
+}
+
+void graph_snapshot::DistancesTo(int32_t goal, std::vector<int32_t> &distance, std::vector<int32_t> &hops, std::vector<uint64_t> &heap) const
+{
+  distance.assign(NumVertexSlots(), INT32_MAX);
+  hops.assign(NumVertexSlots(), -1);
+  heap.clear();
+  if (goal == -1)
+    return;
+  hops[goal] = 0;
+  ShortestDistances(
+      goal, distance, heap,
+      [&](int32_t v, auto &relax)
+      {
+        for (int32_t e = offsets_[v]; e < offsets_[v + 1]; e++)
+        {
+          if (relax(targets_[e], reverse_costs_[e]))
+            hops[targets_[e]] = hops[v] + 1;
+        }
+      },
+      [](int32_t) { return true; });
+}
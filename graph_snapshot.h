@@ -0,0 +1,177 @@
+/**
+ * @file graph_snapshot.h
+ * @brief Definition of the graph_snapshot class, an immutable copy of a graph, and of the integer Dijkstra shared by the searches.
+ */
+
+#pragma once
+
+#include "graph.h"
+
+/**
+ * @brief Runs Dijkstra with non-negative integer costs from one vertex, until the heap runs out or visit stops it.
+ *
+ * The heap holds (distance << 32 | vertex) keys, so one integer comparison orders it.
+ * @tparam Distance An integer type holding distances below 2^32.
+ * @tparam ForEachEdge Callable as for_each_edge(v, relax): calls relax(u, cost) for every half-edge leaving v in
+ * the search direction. relax returns true if it lowered the distance of u.
+ * @tparam Visit Callable as visit(v) when v is settled, returning false to stop the search.
+ * @param source The vertex index to start from.
+ * @param distance The distance of each vertex, filled by the caller with the unreachable value; the source is set to 0.
+ * @param heap The heap buffer, cleared first; it keeps its capacity between calls.
+ * @param for_each_edge The edge enumerator.
+ * @param visit The settle callback.
+ */
+template <typename Distance, typename ForEachEdge, typename Visit>
+void ShortestDistances(int32_t source, std::vector<Distance> &distance, std::vector<uint64_t> &heap, ForEachEdge for_each_edge, Visit visit)
+{
+  std::greater<uint64_t> compare;
+  heap.clear();
+  distance[source] = 0;
+  heap.push_back((uint32_t)source);
+  Distance d = 0;
+  auto relax = [&](int32_t u, Distance cost)
+  {
+    Distance nd = d + cost;
+    if (nd >= distance[u])
+      return false;
+    distance[u] = nd;
+    heap.push_back((uint64_t)nd << 32 | (uint32_t)u);
+    std::push_heap(heap.begin(), heap.end(), compare);
+    return true;
+  };
+  while (!heap.empty())
+  {
+    std::pop_heap(heap.begin(), heap.end(), compare);
+    uint64_t top = heap.back();
+    heap.pop_back();
+    d = top >> 32;
+    int32_t v = (uint32_t)top;
+    if (d != distance[v])
+      continue;
+    if (!visit(v))
+      return;
+    for_each_edge(v, relax);
+  }
+}
+
+/**
+ * @class graph_snapshot
+ * @brief Immutable compressed sparse row copy of a graph and of its cost policy.
+ *
+ * distance_matrix and multi_agent_planner work on a snapshot, so they can run while the graph
+ * keeps changing. Besides the weights, the snapshot stores the CostPolicy::MoveCost of every
+ * half-edge in both directions, so forward and backward searches read their costs directly.
+ */
+class graph_snapshot
+{
+private:
+  uint64_t version_;
+  CostPolicy cost_policy_;
+
+  // The half-edges of vertex v are [offsets_[v], offsets_[v + 1]).
+  std::vector<int32_t> offsets_;
+  std::vector<int32_t> targets_;
+  std::vector<uint16_t> weights_;
+  std::vector<int32_t> costs_;         // MoveCost of v -> target, clamped at 0.
+  std::vector<int32_t> reverse_costs_; // MoveCost of target -> v, clamped at 0.
+  std::vector<Tile> tiles_;
+  std::vector<uint8_t> alive_;
+  std::unordered_map<uint64_t, int32_t, TileKeyHasher> index_;
+
+public:
+  /**
+   * @brief Copies a graph.
+   * @param g The graph to copy. It is not referenced after the constructor returns.
+   */
+  graph_snapshot(const graph &g);
+
+  /**
+   * @brief Returns the number of vertex indices, removed vertices included.
+   * @return The number of vertex slots of the graph at snapshot time.
+   */
+  int32_t NumVertexSlots() const { return tiles_.size(); }
+
+  /**
+   * @brief Returns the position of the first half-edge of a vertex.
+   * @param v The vertex index.
+   * @return The position, to be used with Target, Weight, Cost and ReverseCost.
+   */
+  int32_t EdgesBegin(int32_t v) const { return offsets_[v]; }
+
+  /**
+   * @brief Returns the position after the last half-edge of a vertex.
+   * @param v The vertex index.
+   * @return The end position.
+   */
+  int32_t EdgesEnd(int32_t v) const { return offsets_[v + 1]; }
+
+  /**
+   * @brief Returns the vertex a half-edge leads to.
+   * @param e The position of the half-edge.
+   * @return The vertex index.
+   */
+  int32_t Target(int32_t e) const { return targets_[e]; }
+
+  /**
+   * @brief Returns the weight of a half-edge.
+   * @param e The position of the half-edge.
+   * @return The weight.
+   */
+  uint16_t Weight(int32_t e) const { return weights_[e]; }
+
+  /**
+   * @brief Returns the move cost of a half-edge, without the turn.
+   * @param e The position of the half-edge.
+   * @return The CostPolicy::MoveCost, at least 0.
+   */
+  int32_t Cost(int32_t e) const { return costs_[e]; }
+
+  /**
+   * @brief Returns the move cost of the opposite half-edge, for backward searches.
+   * @param e The position of the half-edge.
+   * @return The CostPolicy::MoveCost from the target back to the owner of e, at least 0.
+   */
+  int32_t ReverseCost(int32_t e) const { return reverse_costs_[e]; }
+
+  /**
+   * @brief Returns the tile of a vertex.
+   * @param v The vertex index.
+   * @return The tile.
+   */
+  const Tile &GetTile(int32_t v) const { return tiles_[v]; }
+
+  /**
+   * @brief Checks whether a vertex index belongs to a live vertex.
+   * @param v The vertex index.
+   * @return True if the vertex was not removed, false otherwise.
+   */
+  bool IsAlive(int32_t v) const { return alive_[v]; }
+
+  /**
+   * @brief Returns the vertex index of a tile.
+   * @param tile The tile.
+   * @return The vertex index, or -1 if the tile is not in the snapshot.
+   */
+  int32_t GetNode(const Tile &tile) const;
+
+  /**
+   * @brief Computes the backward distances to a goal: the lowest sum of move costs from every vertex to it.
+   * @param goal The goal vertex index, or -1.
+   * @param distance Filled with the distance of each vertex, INT32_MAX where the goal cannot be reached.
+   * @param hops Filled with the number of moves of the path found for each vertex, -1 where the goal cannot be reached.
+   * @param heap The heap buffer.
+   */
+  void DistancesTo(int32_t goal, std::vector<int32_t> &distance, std::vector<int32_t> &hops, std::vector<uint64_t> &heap) const;
+
+  /**
+   * @brief Returns the cost policy of the graph at snapshot time.
+   * @return The cost policy.
+   */
+  const CostPolicy &GetCostPolicy() const { return cost_policy_; }
+
+  /**
+   * @brief Returns the version of the graph the snapshot was taken at.
+   * @return The graph version.
+   */
+  uint64_t Version() const { return version_; }
+};
@@ -0,0 +1,89 @@
+#include "logger.h"
+
+#include <algorithm>
+#include <array>
+
+static log_sink *sink = nullptr;
+static LogLevel threshold = (LogLevel)MAZE_GRAPH_LOG_LEVEL;
+
+// Ring buffer: the records [written - count, written) are unread, at positions modulo the capacity.
+static std::array<LogRecord, kLogRingCapacity> ring;
+static uint32_t written = 0;
+static uint32_t count = 0;
+static uint32_t overwritten = 0;
+
+static const char *const kLevelNames[] = {"D", "I", "W", "E"};
+static const char *const kEventNames[] = {"search finished", "path cache hit"};
+
+ostream_log_sink::ostream_log_sink(std::ostream &os) : os_(os) {}
+
+void ostream_log_sink::Write(LogLevel level, const std::string &message)
+{
+  if (level >= LogLevel::Off)
+    return;
+  os_ << "[" << kLevelNames[(int)level] << "] " << message << '\n';
+}
+
+void SetLogSink(log_sink *new_sink)
+{
+  sink = new_sink;
+}
+
+void SetLogLevel(LogLevel level)
+{
+  threshold = std::max(level, (LogLevel)MAZE_GRAPH_LOG_LEVEL);
+}
+
+bool IsLogEnabled(LogLevel level)
+{
+  return level >= threshold && level != LogLevel::Off;
+}
+
+void WriteLog(LogLevel level, const std::string &message)
+{
+  if (sink != nullptr && level < LogLevel::Off)
+    sink->Write(level, message);
+}
+
+void RecordLog(LogLevel level, LogEvent event, int32_t value0, int32_t value1, int32_t value2)
+{
+  if (level >= LogLevel::Off)
+    return;
+  ring[written % kLogRingCapacity] = {written, level, event, {value0, value1, value2}};
+  written++;
+  if (count == kLogRingCapacity)
+    overwritten++;
+  else
+    count++;
+}
+
+uint32_t ReadLogRecords(std::vector<LogRecord> &records)
+{
+  records.clear();
+  for (uint32_t i = written - count; i != written; i++)
+  {
+    records.push_back(ring[i % kLogRingCapacity]);
+  }
+  count = 0;
+  uint32_t lost = overwritten;
+  overwritten = 0;
+  return lost;
+}
+
+int FlushLogRecords()
+{
+  int flushed = 0;
+  for (; count > 0; count--)
+  {
+    const LogRecord &record = ring[(written - count) % kLogRingCapacity];
+    MAZE_LOG(record.level, "#" << record.sequence << " " << kEventNames[(int)record.event] << ": "
+                               << record.values[0] << " " << record.values[1] << " " << record.values[2]);
+    flushed++;
+  }
+  if (overwritten > 0)
+  {
+    MAZE_LOG(LogLevel::Warning, overwritten << " log records overwritten");
+    overwritten = 0;
+  }
+  return flushed;
+}
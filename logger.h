@@ -0,0 +1,172 @@
+/**
+ * @file logger.h
+ * @brief Level-filtered logging to a pluggable sink, with a ring buffer of binary records for hot paths.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * @enum LogLevel
+ * @brief Severity of a log message, in increasing order.
+ */
+enum class LogLevel : uint8_t
+{
+  Debug,
+  Info,
+  Warning,
+  Error,
+  Off ///< Only used as a threshold, to disable every message.
+};
+
+/**
+ * @def MAZE_GRAPH_LOG_LEVEL
+ * @brief Compile-time threshold, as the integer value of a LogLevel. Messages below it are compiled out.
+ */
+#ifndef MAZE_GRAPH_LOG_LEVEL
+#define MAZE_GRAPH_LOG_LEVEL 1
+#endif
+
+/**
+ * @enum LogEvent
+ * @brief Identifier of a binary log record; the meaning of the record values depends on it.
+ */
+enum class LogEvent : uint16_t
+{
+  SearchFinished, ///< An A* query finished: expansions, length (-1 if not found), goal vertex index.
+  PathCacheHit    ///< FindPathAStar answered from the path cache: start vertex index, goal vertex index, length.
+};
+
+/**
+ * @struct LogRecord
+ * @brief Fixed-size log entry, written without formatting or allocation by MAZE_LOG_RECORD.
+ */
+struct LogRecord
+{
+  uint32_t sequence; ///< Number of records written before this one.
+  LogLevel level;
+  LogEvent event;
+  int32_t values[3];
+};
+
+/**
+ * @class log_sink
+ * @brief Destination of the formatted log messages.
+ */
+class log_sink
+{
+public:
+  virtual ~log_sink() = default;
+
+  /**
+   * @brief Writes one message. Called on the thread that logs it.
+   * @param level The severity of the message, never LogLevel::Off.
+   * @param message The message, without a trailing newline.
+   */
+  virtual void Write(LogLevel level, const std::string &message) = 0;
+};
+
+/**
+ * @class ostream_log_sink
+ * @brief Sink writing one line per message to a stream, without flushing it.
+ */
+class ostream_log_sink : public log_sink
+{
+private:
+  std::ostream &os_;
+
+public:
+  /**
+   * @brief Constructs a sink writing to the given stream.
+   * @param os The output stream. It must outlive the sink.
+   */
+  ostream_log_sink(std::ostream &os);
+
+  void Write(LogLevel level, const std::string &message) override;
+};
+
+/**
+ * @brief Number of records kept by the ring buffer; when it is full the oldest record is overwritten.
+ */
+constexpr uint32_t kLogRingCapacity = 256;
+
+/**
+ * @brief Sets the destination of the formatted messages. With no sink, which is the default, messages are dropped.
+ * @param sink The sink, or nullptr. It must outlive its use.
+ */
+void SetLogSink(log_sink *sink);
+
+/**
+ * @brief Sets the runtime threshold; messages below it are dropped. It cannot go below MAZE_GRAPH_LOG_LEVEL.
+ * @param level The lowest level to keep.
+ */
+void SetLogLevel(LogLevel level);
+
+/**
+ * @brief Checks whether messages of a level pass the runtime threshold.
+ * @param level The level to check.
+ * @return True if the messages are kept, false otherwise.
+ */
+bool IsLogEnabled(LogLevel level);
+
+/**
+ * @brief Sends a formatted message to the sink. Prefer the MAZE_LOG macro, which skips the formatting of dropped messages.
+ * @param level The severity of the message. LogLevel::Off is not a severity: such a message is dropped.
+ * @param message The message.
+ */
+void WriteLog(LogLevel level, const std::string &message);
+
+/**
+ * @brief Appends a binary record to the ring buffer. Prefer the MAZE_LOG_RECORD macro.
+ * The ring buffer is not synchronised: records must be written and read by one thread.
+ * @param level The severity of the record. A record of level LogLevel::Off is dropped.
+ * @param event The identifier of the record.
+ * @param value0 The first value.
+ * @param value1 The second value.
+ * @param value2 The third value.
+ */
+void RecordLog(LogLevel level, LogEvent event, int32_t value0, int32_t value1, int32_t value2);
+
+/**
+ * @brief Moves the records of the ring buffer to a vector, oldest first.
+ * @param records The vector to store the records.
+ * @return The number of records overwritten before they could be read, since the previous call.
+ */
+uint32_t ReadLogRecords(std::vector<LogRecord> &records);
+
+/**
+ * @brief Formats the records of the ring buffer to the sink, oldest first, e.g. when the control loop is idle.
+ * @return The number of records written.
+ */
+int FlushLogRecords();
+
+/**
+ * @def MAZE_LOG(level, x)
+ * @brief Formats x with operator<< and sends it to the sink, if level passes both thresholds.
+ */
+#define MAZE_LOG(level, x)                                                         \
+  do                                                                               \
+  {                                                                                \
+    if ((int)(level) >= MAZE_GRAPH_LOG_LEVEL && IsLogEnabled(level))               \
+    {                                                                              \
+      std::ostringstream maze_log_stream;                                          \
+      maze_log_stream << x;                                                        \
+      WriteLog(level, maze_log_stream.str());                                      \
+    }                                                                              \
+  } while (0)
+
+/**
+ * @def MAZE_LOG_RECORD(level, event, value0, value1, value2)
+ * @brief Appends a binary record to the ring buffer, if level passes both thresholds.
+ */
+#define MAZE_LOG_RECORD(level, event, value0, value1, value2)                      \
+  do                                                                               \
+  {                                                                                \
+    if ((int)(level) >= MAZE_GRAPH_LOG_LEVEL && IsLogEnabled(level))               \
+      RecordLog(level, event, value0, value1, value2);                             \
+  } while (0)
@@ -0,0 +1,230 @@
+#include "multi_agent_planner.h"
+
+#include <atomic>
+#include <thread>
+
+// The SpaceTimeKey function packs a time step and a vertex index in 64 bits.
+uint64_t SpaceTimeKey(int32_t vertex, int32_t time)
+{
+  return (uint64_t)(uint32_t)time << 32 | (uint32_t)vertex;
+}
+
+reservation_table::reservation_table() : latest_time_(-1) {}
+
+void reservation_table::Clear()
+{
+  vertices_.clear();
+  moves_.clear();
+  parked_.clear();
+  latest_.clear();
+  latest_time_ = -1;
+}
+
+void reservation_table::Reserve(const std::vector<int32_t> &vertices, int32_t agent)
+{
+  if (vertices.empty())
+    return;
+  for (size_t time = 0; time < vertices.size(); time++)
+  {
+    vertices_[SpaceTimeKey(vertices[time], time)] = agent;
+    if (time + 1 < vertices.size())
+      moves_[SpaceTimeKey(vertices[time], time)] = vertices[time + 1];
+    int32_t &latest = latest_.emplace(vertices[time], -1).first->second;
+    latest = std::max(latest, (int32_t)time);
+  }
+  parked_[vertices.back()] = vertices.size() - 1;
+  latest_time_ = std::max(latest_time_, (int32_t)vertices.size() - 1);
+}
+
+bool reservation_table::IsFree(int32_t vertex, int32_t time) const
+{
+  auto parked = parked_.find(vertex);
+  if (parked != parked_.end() && parked->second <= time)
+    return false;
+  return vertices_.find(SpaceTimeKey(vertex, time)) == vertices_.end();
+}
+
+bool reservation_table::CanMove(int32_t from, int32_t to, int32_t time) const
+{
+  if (!IsFree(to, time + 1))
+    return false;
+  if (from == to)
+    return true;
+  auto swap = moves_.find(SpaceTimeKey(to, time));
+  return swap == moves_.end() || swap->second != from;
+}
+
+bool reservation_table::CanPark(int32_t vertex, int32_t time) const
+{
+  if (parked_.find(vertex) != parked_.end())
+    return false;
+  auto latest = latest_.find(vertex);
+  return latest == latest_.end() || latest->second < time;
+}
+
+int32_t reservation_table::LatestTime() const
+{
+  return latest_time_;
+}
+
+//--------------------
+
+multi_agent_planner::multi_agent_planner(const graph &g) : snapshot_(g), wait_cost_(1), max_time_(0) {}
+
+void multi_agent_planner::SetWaitCost(int32_t cost)
+{
+  wait_cost_ = std::max(cost, 1);
+}
+
+void multi_agent_planner::SetMaxTime(int32_t max_time)
+{
+  max_time_ = max_time;
+}
+
+// The PlanAgent function runs A* over (vertex, heading, time) states, skipping the moves the reservations forbid
+// and the start tiles of the agents still waiting to be planned.
+// It stops at the first popped goal state the agent can stay on forever.
+bool multi_agent_planner::PlanAgent(int32_t start, int32_t goal, int direction, Workspace &workspace, std::vector<int32_t> &vertices, int32_t &cost) const
+{
+  const std::vector<int32_t> &heuristic = workspace.heuristic;
+  std::vector<uint64_t> &heap = workspace.heap;
+  std::vector<SpaceTimeNode> &nodes = workspace.nodes;
+  std::greater<uint64_t> compare;
+  vertices.clear();
+  cost = -1;
+  heap.clear();
+  nodes.clear();
+  workspace.best_cost.clear();
+  if (start == -1 || goal == -1 || direction < 0 || direction > 3 || heuristic[start] == INT32_MAX || !reservations_.IsFree(start, 0) || waiting_[start] > 0)
+    return false;
+  int32_t max_time = max_time_ > 0 ? max_time_ : reservations_.LatestTime() + 2 * workspace.hops[start] + 1;
+  if (!reservations_.CanPark(goal, max_time))
+    return false;
+
+  auto push = [&](int32_t parent, int32_t to, int new_direction, int32_t new_cost)
+  {
+    int32_t time = nodes[parent].time + 1;
+    if (waiting_[to] > 0 || !reservations_.CanMove(nodes[parent].vertex, to, time - 1))
+      return;
+    int32_t &best = workspace.best_cost.emplace(SpaceTimeKey(to * 4 + new_direction, time), INT32_MAX).first->second;
+    if (new_cost >= best)
+      return;
+    best = new_cost;
+    nodes.push_back({to, time, new_cost, parent, new_direction});
+    heap.push_back((uint64_t)(uint32_t)(new_cost + heuristic[to]) << 32 | (uint32_t)(nodes.size() - 1));
+    std::push_heap(heap.begin(), heap.end(), compare);
+  };
+
+  nodes.push_back({start, 0, 0, -1, direction});
+  workspace.best_cost[SpaceTimeKey(start * 4 + direction, 0)] = 0;
+  heap.push_back((uint64_t)(uint32_t)heuristic[start] << 32);
+  while (!heap.empty())
+  {
+    std::pop_heap(heap.begin(), heap.end(), compare);
+    int32_t position = (uint32_t)heap.back();
+    heap.pop_back();
+    SpaceTimeNode node = nodes[position];
+    if (node.cost > workspace.best_cost[SpaceTimeKey(node.vertex * 4 + node.direction, node.time)])
+      continue;
+
+    if (node.vertex == goal && reservations_.CanPark(goal, node.time))
+    {
+      for (int32_t current = position; current != -1; current = nodes[current].parent)
+      {
+        vertices.push_back(nodes[current].vertex);
+      }
+      std::reverse(vertices.begin(), vertices.end());
+      cost = node.cost;
+      return true;
+    }
+    if (node.time >= max_time)
+      continue;
+
+    push(position, node.vertex, node.direction, node.cost + wait_cost_);
+    for (int32_t e = snapshot_.EdgesBegin(node.vertex); e < snapshot_.EdgesEnd(node.vertex); e++)
+    {
+      int32_t to = snapshot_.Target(e);
+      if (heuristic[to] == INT32_MAX)
+        continue;
+      int new_direction;
+      int32_t step = snapshot_.GetCostPolicy().StepCost(snapshot_.GetTile(node.vertex), node.direction, snapshot_.GetTile(to), snapshot_.Weight(e), new_direction);
+      push(position, to, new_direction, node.cost + step);
+    }
+  }
+  return false;
+}
+
+int multi_agent_planner::Plan(const std::vector<AgentRequest> &agents, std::vector<AgentPlan> &plans, int num_threads)
+{
+  int32_t num_agents = agents.size();
+  reservations_.Clear();
+  plans.assign(num_agents, {{}, -1});
+  if (workspaces_.size() < agents.size())
+    workspaces_.resize(agents.size());
+
+  std::vector<int32_t> starts, goals;
+  waiting_.assign(snapshot_.NumVertexSlots(), 0);
+  for (const AgentRequest &agent : agents)
+  {
+    starts.push_back(snapshot_.GetNode(agent.start));
+    goals.push_back(snapshot_.GetNode(agent.goal));
+    if (starts.back() != -1)
+      waiting_[starts.back()]++;
+  }
+
+  // The heuristics only depend on the snapshot, so they are computed in parallel.
+  if (num_threads <= 0)
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  num_threads = std::max(1, std::min(num_threads, num_agents));
+  std::atomic<int32_t> next_agent(0);
+  auto worker = [&]()
+  {
+    for (int32_t i = next_agent.fetch_add(1, std::memory_order_relaxed); i < num_agents; i = next_agent.fetch_add(1, std::memory_order_relaxed))
+    {
+      snapshot_.DistancesTo(goals[i], workspaces_[i].heuristic, workspaces_[i].hops, workspaces_[i].heap);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int t = 1; t < num_threads; t++)
+  {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : threads)
+  {
+    thread.join();
+  }
+
+  int found = 0;
+  std::vector<int32_t> vertices;
+  for (int32_t i = 0; i < num_agents; i++)
+  {
+    // Until now the agent was held on its start tile; a failed agent stays there.
+    if (starts[i] != -1)
+      waiting_[starts[i]]--;
+    if (PlanAgent(starts[i], goals[i], agents[i].direction, workspaces_[i], vertices, plans[i].cost))
+    {
+      for (int32_t vertex : vertices)
+      {
+        plans[i].path.push_back(snapshot_.GetTile(vertex));
+      }
+      found++;
+    }
+    else if (starts[i] != -1)
+    {
+      vertices.assign(1, starts[i]);
+    }
+    reservations_.Reserve(vertices, i);
+  }
+  return found;
+}
+
+const reservation_table &multi_agent_planner::Reservations() const
+{
+  return reservations_;
+}
+
+uint64_t multi_agent_planner::SnapshotVersion() const
+{
+  return snapshot_.Version();
+}
@@ -0,0 +1,200 @@
+/**
+ * @file multi_agent_planner.h
+ * @brief Definition of the reservation_table and multi_agent_planner classes, collision-free paths for several robots.
+ */
+
+#pragma once
+
+#include "graph_snapshot.h"
+
+/**
+ * @class reservation_table
+ * @brief Space-time occupancy of the vertices of a graph, in discrete time steps.
+ *
+ * A reserved path occupies one vertex per time step. Two agents may not be on the same
+ * vertex at the same step, nor swap vertices over the same edge between two steps.
+ * An agent that has reached its goal is parked there and occupies it from then on.
+ */
+class reservation_table
+{
+private:
+  std::unordered_map<uint64_t, int32_t> vertices_; // (time << 32 | vertex) -> agent.
+  std::unordered_map<uint64_t, int32_t> moves_;    // (time << 32 | from) -> vertex reached at time + 1.
+  std::unordered_map<int32_t, int32_t> parked_;    // Vertex -> first time step it is parked on.
+  std::unordered_map<int32_t, int32_t> latest_;    // Vertex -> last time step it is reserved at.
+  int32_t latest_time_;                            // Last time step of any reservation, -1 if none.
+
+public:
+  /**
+   * @brief Constructs an empty table.
+   */
+  reservation_table();
+
+  /**
+   * @brief Removes every reservation.
+   */
+  void Clear();
+
+  /**
+   * @brief Reserves a path and parks its agent on the last vertex.
+   * @param vertices The vertex index of the agent at each time step, from time 0.
+   * @param agent The identifier of the agent.
+   */
+  void Reserve(const std::vector<int32_t> &vertices, int32_t agent);
+
+  /**
+   * @brief Checks whether a vertex is free at a time step.
+   * @param vertex The vertex index.
+   * @param time The time step.
+   * @return True if no agent occupies the vertex at that time, false otherwise.
+   */
+  bool IsFree(int32_t vertex, int32_t time) const;
+
+  /**
+   * @brief Checks whether an agent can go from a vertex to another between two time steps.
+   * Waiting is a move with from equal to to.
+   * @param from The vertex index at the given time.
+   * @param to The vertex index at the next time step.
+   * @param time The time step the move starts at.
+   * @return True if the target is free at time + 1 and no agent moves the opposite way, false otherwise.
+   */
+  bool CanMove(int32_t from, int32_t to, int32_t time) const;
+
+  /**
+   * @brief Checks whether an agent can stay on a vertex forever from a time step.
+   * @param vertex The vertex index.
+   * @param time The first time step.
+   * @return True if no agent occupies the vertex at that time or later, false otherwise.
+   */
+  bool CanPark(int32_t vertex, int32_t time) const;
+
+  /**
+   * @brief Returns the last time step any path is reserved at; after it only the parked vertices are occupied.
+   * @return The time step, or -1 if nothing is reserved.
+   */
+  int32_t LatestTime() const;
+};
+
+/**
+ * @struct AgentRequest
+ * @brief Start and goal of one agent, as consumed by multi_agent_planner::Plan.
+ */
+struct AgentRequest
+{
+  Tile start;
+  Tile goal;
+  int direction; ///< The direction the agent faces on the start tile.
+};
+
+/**
+ * @struct AgentPlan
+ * @brief Path of one agent, as produced by multi_agent_planner::Plan.
+ */
+struct AgentPlan
+{
+  std::vector<Tile> path; ///< The tile of the agent at each time step; a repeated tile is a wait. Empty if no plan was found.
+  int32_t cost;           ///< The CostPolicy cost of the path plus the waits, or -1 if no plan was found.
+};
+
+/**
+ * @class multi_agent_planner
+ * @brief Prioritized planner of collision-free paths for several agents on the same graph.
+ *
+ * The constructor takes a graph_snapshot, like distance_matrix, so several planners can work
+ * on the same map while it keeps changing. Agents are planned in priority order with a
+ * space-time A* over (vertex, heading, time) states that avoids the reservations of the agents
+ * planned before them and the start tiles of the agents after them, which are held there until
+ * they are planned. Every agent has its own workspace: the exact backward distances to its
+ * goal, used as the heuristic, are computed for all the agents in parallel before the
+ * sequential space-time pass.
+ *
+ * Each move or wait takes one time step. Prioritized planning is not complete: an agent may
+ * find no plan when the agents before it block its way. The search of an agent stops at its
+ * time horizon, and fails at once when its goal cannot be parked on within it.
+ */
+class multi_agent_planner
+{
+private:
+  graph_snapshot snapshot_;
+  int32_t wait_cost_;
+  int32_t max_time_;
+
+  /**
+   * @struct SpaceTimeNode
+   * @brief Node of the space-time search tree of one agent.
+   */
+  struct SpaceTimeNode
+  {
+    int32_t vertex;
+    int32_t time;
+    int32_t cost;
+    int32_t parent; ///< Position of the parent in Workspace::nodes, -1 for the start.
+    int direction;
+  };
+
+  /**
+   * @struct Workspace
+   * @brief Search state of one agent. The buffers keep their capacity between Plan calls.
+   */
+  struct Workspace
+  {
+    std::vector<int32_t> heuristic;                   // Backward distance to the goal per vertex.
+    std::vector<int32_t> hops;                        // Moves of the shortest path to the goal per vertex.
+    std::vector<uint64_t> heap;                       // (priority << 32 | position) keys.
+    std::vector<SpaceTimeNode> nodes;
+    std::unordered_map<uint64_t, int32_t> best_cost; // (time << 32 | vertex * 4 + direction) -> lowest cost seen.
+  };
+  std::vector<Workspace> workspaces_;
+  reservation_table reservations_;
+  std::vector<int32_t> waiting_; // Vertex -> number of agents not planned yet that start on it.
+
+  bool PlanAgent(int32_t start, int32_t goal, int direction, Workspace &workspace, std::vector<int32_t> &vertices, int32_t &cost) const;
+
+public:
+  /**
+   * @brief Takes a snapshot of a graph and its cost policy.
+   * @param g The graph to snapshot. It is not referenced after the constructor returns.
+   */
+  multi_agent_planner(const graph &g);
+
+  /**
+   * @brief Sets the cost of waiting on a tile for one time step.
+   * @param cost The cost of a wait, at least 1 so waiting forever is never free.
+   */
+  void SetWaitCost(int32_t cost);
+
+  /**
+   * @brief Sets the last time step a plan may reach its goal at, bounding the space-time search.
+   *
+   * With the default of 0 the horizon of each agent is the last time step reserved by the agents
+   * before it plus twice the number of moves of its shortest path: enough to wait for the others
+   * to pass and to take a detour as long as that path. The search of an agent then visits at most
+   * 4 * vertices * horizon states.
+   * @param max_time The time horizon, or 0 for the per-agent default.
+   */
+  void SetMaxTime(int32_t max_time);
+
+  /**
+   * @brief Plans every agent, discarding the reservations of the previous call.
+   *
+   * An agent without a plan is parked on its start tile. No plan enters that tile: the agents
+   * before it avoided it while it was waiting to be planned, and the agents after it go around it.
+   * @param agents The agents, highest priority first.
+   * @param plans The vector to store the plan of each agent, in the same order.
+   * @param num_threads The number of worker threads for the heuristics, 0 for one per hardware thread.
+   * @return The number of agents with a plan.
+   */
+  int Plan(const std::vector<AgentRequest> &agents, std::vector<AgentPlan> &plans, int num_threads = 0);
+
+  /**
+   * @brief Returns the reservations of the last Plan call, indexed by the vertex indices of the snapshot.
+   * @return The reservation table.
+   */
+  const reservation_table &Reservations() const;
+
+  /**
+   * @brief Returns the version of the graph the snapshot was taken at.
+   * @return The graph version.
+   */
+  uint64_t SnapshotVersion() const;
+};
@@ -0,0 +1,250 @@
+/**
+ * @file mutation_queue.h
+ * @brief Definition of the mutation_queue class, a lock-free queue of graph mutations between two threads.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+#include "graph.h"
+
+/**
+ * @brief Kinds of graph mutation carried by a mutation_queue.
+ */
+enum class MutationType : uint8_t
+{
+  AddVertex,    ///< graph::AddVertex(from).
+  AddEdge,      ///< graph::AddEdge(from, to, weight).
+  RemoveEdge,   ///< graph::RemoveEdge(from, to).
+  ChangeWeight, ///< graph::ChangeTileWeight(from, to, weight).
+  RemoveVertex, ///< graph::RemoveVertex(from).
+  Observe       ///< A TileObservation of from, with walls and weight; consecutive ones are applied as one batch.
+};
+
+/**
+ * @struct GraphMutation
+ * @brief One queued graph mutation. The fields not used by its type are ignored.
+ */
+struct GraphMutation
+{
+  MutationType type;
+  Tile from;
+  Tile to;
+  uint16_t weight;
+  uint8_t walls;
+};
+
+/**
+ * @class mutation_queue
+ * @brief Bounded single-producer/single-consumer ring buffer of graph mutations.
+ *
+ * The producer (e.g. the sensor thread) calls Push, the consumer (the planner) calls Drain
+ * at a safe point between searches; the graph itself is only touched by the consumer.
+ * Neither side ever blocks and Push never allocates: it fails when the ring is full. The producer and
+ * consumer positions live on separate cache lines, and each side keeps a cached copy of the
+ * other's position so it only reads the shared one when the ring looks full or empty.
+ *
+ * @tparam Capacity The number of slots, a power of two.
+ */
+template <uint32_t Capacity>
+class mutation_queue
+{
+private:
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+  std::array<GraphMutation, Capacity> slots_;
+
+  // Positions grow without bound and are masked on access, so full and empty are told apart.
+  alignas(64) std::atomic<uint32_t> tail_; // Written by the producer.
+  uint32_t cached_head_;                   // Producer's copy of head_.
+  alignas(64) std::atomic<uint32_t> head_; // Written by the consumer.
+  uint32_t cached_tail_;                   // Consumer's copy of tail_.
+
+  // Consumer-side buffer of consecutive observations, reserved once.
+  std::vector<TileObservation> observations_;
+  ChangeSet batch_;   // Changes of the last observation batch or single mutation.
+  ChangeSet changes_; // Changes accumulated since the last TakeChanges call.
+
+  void FlushObservations(graph &g)
+  {
+    if (observations_.empty())
+      return;
+    g.ApplyObservations(observations_, batch_);
+    changes_.Append(batch_);
+    observations_.clear();
+  }
+
+  // The EdgeWeight function returns the weight of the half-edge from -> to, or 0 if there is none.
+  static uint16_t EdgeWeight(const graph &g, int32_t from, int32_t to)
+  {
+    for (const EdgeView &edge : g.Neighbours(from))
+    {
+      if (edge.vertex_index == to)
+        return edge.weight;
+    }
+    return 0;
+  }
+
+  // The Apply function applies one mutation other than an observation and records what it changed in batch_.
+  void Apply(graph &g, const GraphMutation &mutation)
+  {
+    batch_.Clear();
+    int32_t from = g.GetNode(mutation.from);
+    int32_t to = g.GetNode(mutation.to);
+    std::pair<int32_t, int32_t> edge(std::min(from, to), std::max(from, to));
+    switch (mutation.type)
+    {
+    case MutationType::AddVertex:
+      if (g.AddVertex(mutation.from))
+        batch_.added_vertices.push_back(g.GetNode(mutation.from));
+      break;
+    case MutationType::AddEdge:
+      if (g.AddEdge(mutation.from, mutation.to, mutation.weight))
+      {
+        batch_.added_edges.push_back(edge);
+        batch_.vertices = {edge.first, edge.second};
+      }
+      break;
+    case MutationType::RemoveEdge:
+      if (g.RemoveEdge(mutation.from, mutation.to))
+      {
+        batch_.removed_edges.push_back(edge);
+        batch_.vertices = {edge.first, edge.second};
+      }
+      break;
+    case MutationType::ChangeWeight:
+    {
+      uint16_t old_weight = from == -1 || to == -1 ? 0 : EdgeWeight(g, from, to);
+      uint16_t old_reverse_weight = from == -1 || to == -1 ? 0 : EdgeWeight(g, to, from);
+      if (g.ChangeTileWeight(mutation.from, mutation.to, mutation.weight))
+      {
+        batch_.edges.push_back({from, to, old_weight, mutation.weight});
+        batch_.edges.push_back({to, from, old_reverse_weight, mutation.weight});
+        batch_.vertices = {edge.first, edge.second};
+      }
+      break;
+    }
+    case MutationType::RemoveVertex:
+      // The to field is ignored: the owners of the removed half-edges are the vertex and its neighbours.
+      if (from != -1)
+      {
+        for (const EdgeView &neighbour : g.Neighbours(from))
+        {
+          batch_.removed_edges.push_back({std::min(from, neighbour.vertex_index), std::max(from, neighbour.vertex_index)});
+          batch_.vertices.push_back(neighbour.vertex_index);
+        }
+        if (!batch_.vertices.empty())
+          batch_.vertices.push_back(from);
+        if (g.RemoveVertex(mutation.from))
+          batch_.removed_vertices.push_back(from);
+        else
+          batch_.Clear();
+        std::sort(batch_.vertices.begin(), batch_.vertices.end());
+      }
+      break;
+    default:
+      break;
+    }
+    batch_.version = g.Version();
+    changes_.Append(batch_);
+  }
+
+public:
+  /**
+   * @brief Constructs an empty queue.
+   */
+  mutation_queue() : tail_(0), cached_head_(0), head_(0), cached_tail_(0)
+  {
+    observations_.reserve(Capacity);
+  }
+
+  /**
+   * @brief Enqueues a mutation. Only the producer thread may call it.
+   * @param mutation The mutation to enqueue.
+   * @return True if the mutation is enqueued, false if the queue is full.
+   */
+  bool Push(const GraphMutation &mutation)
+  {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == Capacity)
+    {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ == Capacity)
+        return false;
+    }
+    slots_[tail & (Capacity - 1)] = mutation;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Dequeues a mutation. Only the consumer thread may call it.
+   * @param mutation The dequeued mutation.
+   * @return True if a mutation is dequeued, false if the queue is empty.
+   */
+  bool Pop(GraphMutation &mutation)
+  {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_)
+    {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_)
+        return false;
+    }
+    mutation = slots_[head & (Capacity - 1)];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Applies the queued mutations to a graph, in order. Only the consumer thread may call it.
+   * Runs of consecutive observations are coalesced by graph::ApplyObservations. What the mutations
+   * changed is added to the change set returned by TakeChanges.
+   * @param g The graph to mutate.
+   * @param max_mutations The maximum number of mutations to dequeue, negative for all the queued ones.
+   * @return The number of mutations dequeued.
+   */
+  int Drain(graph &g, int max_mutations = -1)
+  {
+    int count = 0;
+    GraphMutation mutation;
+    while (count != max_mutations && Pop(mutation))
+    {
+      count++;
+      if (mutation.type == MutationType::Observe)
+      {
+        if (observations_.size() == Capacity)
+          FlushObservations(g);
+        observations_.push_back({mutation.from, mutation.walls, mutation.weight});
+        continue;
+      }
+      FlushObservations(g);
+      Apply(g, mutation);
+    }
+    FlushObservations(g);
+    return count;
+  }
+
+  /**
+   * @brief Moves out what the Drain calls changed since the previous call, as one consolidated change set.
+   * Only the consumer thread may call it. Vertex indices are those of the graph before any Compact call.
+   * @param changes The change set to store the changes; its previous content is discarded.
+   */
+  void TakeChanges(ChangeSet &changes)
+  {
+    std::swap(changes, changes_);
+    changes_.Clear();
+  }
+
+  /**
+   * @brief Returns the number of queued mutations. Exact only when called from one of the two threads while the other is idle.
+   * @return The number of queued mutations.
+   */
+  uint32_t Size() const
+  {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+};
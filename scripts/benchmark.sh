@@ -0,0 +1,7 @@
+#! /bin/sh
+
+cd "$(dirname "$0")"
+
+cd ..;
+
+g++ -O2 -pthread graph.cpp graph_snapshot.cpp corridor_graph.cpp distance_matrix.cpp multi_agent_planner.cpp logger.cpp benchmark.cpp -o run_benchmark && ./run_benchmark "$@"
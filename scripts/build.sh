@@ -4,4 +4,4 @@ cd "$(dirname "$0")"
 
 cd ..;
 
-g++ graph.cpp main.cpp -o run_me
\ No newline at end of file
+g++ -pthread graph.cpp graph_snapshot.cpp corridor_graph.cpp distance_matrix.cpp multi_agent_planner.cpp logger.cpp main.cpp -o run_me
\ No newline at end of file
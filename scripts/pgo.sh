@@ -0,0 +1,26 @@
+#! /bin/sh
+
+cd "$(dirname "$0")"
+
+cd ..;
+
+# Two-stage profile-guided build: instrument, profile the benchmark mazes, rebuild with the profiles.
+BUILD_DIR=${BUILD_DIR:-build-pgo}
+PGO_DIR="$PWD/$BUILD_DIR/pgo"
+
+rm -rf "$PGO_DIR" && mkdir -p "$PGO_DIR" || exit 1
+
+cmake -S . -B "$BUILD_DIR" -DCMAKE_BUILD_TYPE=Release -DMAZE_GRAPH_PGO=GENERATE -DMAZE_GRAPH_PGO_DIR="$PGO_DIR" "$@" &&
+cmake --build "$BUILD_DIR" --clean-first -j || exit 1
+
+for side in 30 60 120; do
+  "$BUILD_DIR/run_benchmark" $side || exit 1
+done
+
+if ls "$PGO_DIR"/*.profraw >/dev/null 2>&1; then
+  llvm-profdata merge -output="$PGO_DIR/merged.profdata" "$PGO_DIR"/*.profraw || exit 1
+fi
+
+cmake -S . -B "$BUILD_DIR" -DMAZE_GRAPH_PGO=USE &&
+cmake --build "$BUILD_DIR" --clean-first -j &&
+"$BUILD_DIR/run_benchmark"
@@ -0,0 +1,372 @@
+// Differential test of the path searches against graph::FindPathReference.
+//
+// Random multi-floor mazes are built and then mutated with AddVertex, AddEdge, RemoveEdge,
+// ChangeTileWeight, RemoveVertex and Compact, mirrored on a fixed_graph, and checked with
+// graph::CheckInvariants after every mutation. fixed_graph cannot remove a vertex, so it only
+// drops the edges of a removed one and the tile is left out of the mirrored mutations until it is
+// added back. Vertex handles must follow their vertices through Compact and stay invalid once their
+// vertex is removed, and IsCutVertex and IsBridge are checked by removing each vertex and edge in turn
+// and counting the components. Between mutations, random queries run FindPathAStar, AStarSearch,
+// corridor_graph::FindPath and fixed_graph::FindPathAStar, which must find a valid path of
+// the reference cost, and FindPathDFS, which must find a valid path whenever one exists.
+// The maneuvers of AStarSearch and FindPathAStar must match graph::GetManeuvers of their paths.
+//
+// Usage: differential_test [seed]
+
+#include "graph.h"
+#include "corridor_graph.h"
+#include "fixed_graph.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unordered_set>
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                                           \
+  do                                                                    \
+  {                                                                     \
+    if (!(condition))                                                   \
+    {                                                                   \
+      if (failures < 20)                                                \
+      {                                                                 \
+        std::printf("%s:%d: CHECK(%s) failed: ", __FILE__, __LINE__, #condition); \
+        std::printf(__VA_ARGS__);                                       \
+        std::printf("\n");                                              \
+      }                                                                 \
+      failures++;                                                       \
+    }                                                                   \
+  } while (0)
+
+constexpr int32_t kMaxSide = 8;
+constexpr int32_t kFloors = 2;
+
+static fixed_graph<kMaxSide * kMaxSide * kFloors, 4 * kMaxSide * kMaxSide * kFloors> fixed;
+static std::array<Tile, decltype(fixed)::kMaxPathSize> fixed_path;
+
+// The WalkCost function returns the CostPolicy cost of a path, or -1 if two consecutive tiles are not adjacent.
+// With sum_weights, it returns the plain sum of the edge weights instead.
+int64_t WalkCost(const graph &g, const std::vector<Tile> &path, int direction, bool sum_weights)
+{
+  int64_t cost = 0;
+  for (size_t i = 1; i < path.size(); i++)
+  {
+    int32_t from = g.GetNode(path[i - 1]);
+    int32_t to = g.GetNode(path[i]);
+    int32_t weight = -1;
+    if (from != -1 && to != -1)
+    {
+      for (const EdgeView &edge : g.Neighbours(from))
+      {
+        if (edge.vertex_index == to)
+          weight = edge.weight;
+      }
+    }
+    if (weight == -1)
+      return -1;
+    cost += sum_weights ? weight : g.GetCostPolicy().StepCost(path[i - 1], direction, path[i], weight, direction);
+  }
+  return cost;
+}
+
+// The CheckPath function checks the result of one search against the reference cost.
+void CheckPath(const char *name, const graph &g, const Tile &start, const Tile &goal, int direction, const std::vector<Tile> &path, int len, int reference)
+{
+  CHECK(len == reference, "%s: cost %d, reference %d", name, len, reference);
+  if (len == -1 || reference == -1)
+    return;
+  CHECK(!path.empty() && path.front() == start && path.back() == goal, "%s: path does not join start and goal", name);
+  CHECK(WalkCost(g, path, direction, false) == len, "%s: path cost %lld, reported %d", name, (long long)WalkCost(g, path, direction, false), len);
+}
+
+// The SameManeuvers function compares two maneuver lists field by field.
+bool SameManeuvers(const std::vector<Maneuver> &a, const std::vector<Maneuver> &b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++)
+  {
+    if (a[i].type != b[i].type || a[i].count != b[i].count || a[i].cost != b[i].cost)
+      return false;
+  }
+  return true;
+}
+
+Tile RandomTile(std::mt19937 &random, int32_t height, int32_t width)
+{
+  return {(int32_t)(random() % height), (int32_t)(random() % width), (int32_t)(random() % kFloors)};
+}
+
+// The Neighbour function returns a tile next to the given one: lateral on the same floor, or straight up or down (a ramp).
+Tile Neighbour(std::mt19937 &random, const Tile &tile)
+{
+  const int32_t steps[6][3] = {{1, 0, 0}, {0, 1, 0}, {-1, 0, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+  const int32_t *step = steps[random() % 6];
+  return {tile.y + step[0], tile.x + step[1], tile.z + step[2]};
+}
+
+// The CountComponents function counts the connected components of the live vertices by breadth-first search,
+// leaving out one vertex and one edge, either of which may be -1.
+int32_t CountComponents(const graph &g, int32_t skip_vertex, int32_t skip_u, int32_t skip_w)
+{
+  std::vector<uint8_t> seen(g.NumVertexSlots(), 0);
+  std::vector<int32_t> queue;
+  int32_t components = 0;
+  for (int32_t root = 0; root < g.NumVertexSlots(); root++)
+  {
+    if (seen[root] || g.IsRemoved(root) || root == skip_vertex)
+      continue;
+    components++;
+    seen[root] = 1;
+    queue.assign(1, root);
+    for (size_t i = 0; i < queue.size(); i++)
+    {
+      int32_t v = queue[i];
+      for (const EdgeView &edge : g.Neighbours(v))
+      {
+        int32_t u = edge.vertex_index;
+        bool skipped = (v == skip_u && u == skip_w) || (v == skip_w && u == skip_u);
+        if (seen[u] || u == skip_vertex || skipped)
+          continue;
+        seen[u] = 1;
+        queue.push_back(u);
+      }
+    }
+  }
+  return components;
+}
+
+// The CheckCutAnalysis function checks IsCutVertex, IsBridge and NumComponents by brute force.
+void CheckCutAnalysis(const graph &g)
+{
+  int32_t components = CountComponents(g, -1, -1, -1);
+  CHECK(g.NumComponents() == components, "NumComponents %d, counted %d", g.NumComponents(), components);
+  for (int32_t v = 0; v < g.NumVertexSlots(); v++)
+  {
+    if (g.IsRemoved(v))
+      continue;
+    const Tile tile = g.GetTile(v);
+    bool isolated = g.Neighbours(v).begin() == g.Neighbours(v).end();
+    bool cut = CountComponents(g, v, -1, -1) > components - (isolated ? 1 : 0);
+    CHECK(g.IsCutVertex(tile) == cut, "IsCutVertex(%d, %d, %d) is %d", tile.y, tile.x, tile.z, (int)!cut);
+    for (const EdgeView &edge : g.Neighbours(v))
+    {
+      if (edge.vertex_index < v)
+        continue;
+      const Tile other = g.GetTile(edge.vertex_index);
+      bool bridge = CountComponents(g, -1, v, edge.vertex_index) > components;
+      CHECK(g.IsBridge(tile, other) == bridge, "IsBridge(%d, %d, %d)-(%d, %d, %d) is %d", tile.y, tile.x, tile.z, other.y, other.x, other.z, (int)!bridge);
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t seed = argc > 1 ? (uint32_t)std::strtoul(argv[1], nullptr, 10) : 1;
+  std::mt19937 random(seed);
+  int num_queries = 0;
+
+  for (int round = 0; round < 150; round++)
+  {
+    graph g;
+    fixed.Clear();
+    int32_t height = 2 + random() % (kMaxSide - 1);
+    int32_t width = 2 + random() % (kMaxSide - 1);
+    CostPolicy policy;
+    if (round % 2)
+    {
+      policy.move = random() % 3;
+      policy.weight_scale = 1 + random() % 2;
+      policy.quarter_turn = random() % 5;
+      policy.turn_around = random() % 7;
+      policy.floor_change = random() % 9;
+    }
+    g.SetCostPolicy(policy);
+    fixed.SetCostPolicy(policy);
+    if (round % 3 == 0)
+      g.SetPathCacheFineGrained(true);
+    corridor_graph corridors(g);
+    AStarSearch search(g);
+
+    // Most tiles of the ground floor and a few of the upper one, with most of their edges.
+    for (int32_t z = 0; z < kFloors; z++)
+    {
+      for (int32_t y = 0; y < height; y++)
+      {
+        for (int32_t x = 0; x < width; x++)
+        {
+          if ((int32_t)(random() % 10) < (z == 0 ? 9 : 3))
+          {
+            g.AddVertex({y, x, z});
+            fixed.AddVertex({y, x, z});
+          }
+        }
+      }
+    }
+    for (int32_t z = 0; z < kFloors; z++)
+    {
+      for (int32_t y = 0; y < height; y++)
+      {
+        for (int32_t x = 0; x < width; x++)
+        {
+          const Tile tile{y, x, z};
+          const Tile others[3] = {{y + 1, x, z}, {y, x + 1, z}, {y, x, z + 1}};
+          for (const Tile &other : others)
+          {
+            uint16_t weight = 1 + random() % 4;
+            if (random() % 3 != 0 && g.AddEdge(tile, other, weight))
+              fixed.AddEdge(tile, other, weight);
+          }
+        }
+      }
+    }
+    CHECK(g.CheckInvariants(), "round %d, initial maze", round);
+    CheckCutAnalysis(g);
+
+    // Tiles removed from g that fixed still holds as isolated vertices, and the handles of removed vertices.
+    std::unordered_set<uint64_t> removed_tiles;
+    std::vector<VertexHandle> stale_handles;
+    for (int operation = 0; operation < 120; operation++)
+    {
+      Tile tile = RandomTile(random, height, width);
+      Tile other = Neighbour(random, tile);
+      uint16_t weight = 1 + random() % 4;
+      bool done = false;
+      bool tile_mirrored = removed_tiles.count(tile.Key()) == 0;
+      bool mirrored = tile_mirrored && removed_tiles.count(other.Key()) == 0;
+      switch (random() % 10)
+      {
+      case 0:
+      case 1:
+        done = g.AddVertex(tile);
+        if (tile_mirrored)
+          CHECK(fixed.AddVertex(tile) == done, "AddVertex disagrees");
+        removed_tiles.erase(tile.Key());
+        break;
+      case 2:
+      case 3:
+        done = g.AddEdge(tile, other, weight);
+        if (mirrored)
+          CHECK(fixed.AddEdge(tile, other, weight) == done, "AddEdge disagrees");
+        break;
+      case 4:
+      case 5:
+        done = g.RemoveEdge(tile, other);
+        if (mirrored)
+          CHECK(fixed.RemoveEdge(tile, other) == done, "RemoveEdge disagrees");
+        break;
+      case 6:
+      case 7:
+        done = g.ChangeTileWeight(tile, other, weight);
+        if (mirrored)
+          CHECK(fixed.ChangeTileWeight(tile, other, weight) == done, "ChangeTileWeight disagrees");
+        break;
+      case 8:
+      {
+        VertexHandle handle = g.GetHandle(tile);
+        std::vector<Tile> neighbours = g.GetAdjacencyList(tile);
+        done = g.RemoveVertex(tile);
+        CHECK(done == (handle.slot != UINT32_MAX), "RemoveVertex disagrees with GetHandle");
+        if (!done)
+          break;
+        CHECK(g.GetNode(tile) == -1 && g.GetNode(handle) == -1, "removed vertex still found");
+        stale_handles.push_back(handle);
+        for (const Tile &neighbour : neighbours)
+        {
+          fixed.RemoveEdge(tile, neighbour);
+        }
+        removed_tiles.insert(tile.Key());
+        break;
+      }
+      default:
+      {
+        // Compact renumbers the live vertices: every handle must follow its vertex.
+        std::vector<std::pair<Tile, VertexHandle>> handles;
+        for (int32_t v = 0; v < g.NumVertexSlots(); v++)
+        {
+          if (!g.IsRemoved(v))
+            handles.push_back({g.GetTile(v), g.GetHandle(g.GetTile(v))});
+        }
+        int32_t removed = g.NumRemovedVertices();
+        int32_t dropped = g.Compact();
+        done = true;
+        CHECK(dropped == removed && g.NumRemovedVertices() == 0, "Compact dropped %d of %d removed vertices", dropped, removed);
+        for (const std::pair<Tile, VertexHandle> &entry : handles)
+        {
+          int32_t index = g.GetNode(entry.second);
+          CHECK(index != -1 && index == g.GetNode(entry.first) && g.GetTile(index) == entry.first, "handle lost its vertex after Compact");
+        }
+        break;
+      }
+      }
+      for (const VertexHandle &handle : stale_handles)
+      {
+        CHECK(g.GetNode(handle) == -1, "stale handle of slot %u found", handle.slot);
+      }
+      if (done)
+        CHECK(g.CheckInvariants(), "round %d, operation %d", round, operation);
+      if (operation % 30 == 29)
+        CheckCutAnalysis(g);
+      if (operation % 4 != 0)
+        continue;
+
+      for (int query = 0; query < 4; query++)
+      {
+        Tile start = RandomTile(random, height, width);
+        Tile goal = query == 0 ? start : RandomTile(random, height, width);
+        int direction = random() % 4;
+        if (g.GetNode(start) == -1 || g.GetNode(goal) == -1)
+          continue;
+        num_queries++;
+        std::vector<Tile> path;
+        int reference;
+        g.FindPathReference(start, goal, path, reference, direction);
+        CHECK(reference == -1 || WalkCost(g, path, direction, false) == reference, "reference path cost");
+
+        int len;
+        // Every other query also asks for the maneuvers, which must match the ones of the path.
+        std::vector<Maneuver> maneuvers, expected;
+        if (query % 2)
+          g.FindPathAStar(start, goal, path, len, direction, maneuvers);
+        else
+          g.FindPathAStar(start, goal, path, len, direction);
+        CheckPath("FindPathAStar", g, start, goal, direction, path, len, reference);
+        g.GetManeuvers(path, direction, expected);
+        CHECK(query % 2 == 0 || len == -1 || SameManeuvers(maneuvers, expected), "FindPathAStar: maneuvers differ from GetManeuvers");
+
+        // Half of the queries opt in to the heuristic, and the search is resumed a few expansions at a time.
+        if (query % 2)
+          g.GetHeuristicTable(goal);
+        search.Start(start, goal, direction);
+        while (search.Step(3) == SearchStatus::Running)
+        {
+        }
+        search.GetPath(path, len, maneuvers);
+        CheckPath("AStarSearch", g, start, goal, direction, path, len, reference);
+        g.GetManeuvers(path, direction, expected);
+        CHECK(SameManeuvers(maneuvers, expected), "AStarSearch: maneuvers differ from GetManeuvers");
+
+        corridors.FindPath(start, goal, path, len, direction);
+        CheckPath("corridor_graph", g, start, goal, direction, path, len, reference);
+
+        int32_t path_size;
+        fixed.FindPathAStar(start, goal, fixed_path, path_size, len, direction);
+        path.assign(fixed_path.begin(), fixed_path.begin() + path_size);
+        CheckPath("fixed_graph", g, start, goal, direction, path, len, reference);
+
+        // The depth-first search is not optimal: it only has to find a valid path when there is one.
+        g.FindPathDFS(start, goal, path, len);
+        CHECK((len == -1) == (reference == -1), "FindPathDFS: found %d, reference %d", len, reference);
+        if (len != -1)
+        {
+          CHECK(path.front() == start && path.back() == goal, "FindPathDFS: path does not join start and goal");
+          CHECK(WalkCost(g, path, direction, true) == len, "FindPathDFS: weight sum %lld, reported %d", (long long)WalkCost(g, path, direction, true), len);
+        }
+      }
+    }
+  }
+
+  std::printf("seed %u: %d queries, %d failures\n", seed, num_queries, failures);
+  return failures == 0 ? 0 : 1;
+}
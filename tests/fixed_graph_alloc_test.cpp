@@ -0,0 +1,79 @@
+// Checks that a static fixed_graph never touches the heap after construction,
+// by counting the calls to the replaceable global operator new.
+
+#include "fixed_graph.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static size_t num_allocations = 0;
+
+void *operator new(size_t size)
+{
+  num_allocations++;
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  std::free(p);
+}
+
+static fixed_graph<64, 128> g;
+static std::array<Tile, fixed_graph<64, 128>::kMaxPathSize> path;
+
+int main()
+{
+  int failures = 0;
+  size_t allocations_before = num_allocations;
+
+  // A 6 x 6 grid on one floor, with a few edges removed and reweighted.
+  for (int32_t y = 0; y < 6; y++)
+  {
+    for (int32_t x = 0; x < 6; x++)
+    {
+      g.AddVertex({y, x, 0});
+    }
+  }
+  for (int32_t y = 0; y < 6; y++)
+  {
+    for (int32_t x = 0; x < 6; x++)
+    {
+      if (x + 1 < 6)
+        g.AddEdge({y, x, 0}, {y, x + 1, 0}, 1);
+      if (y + 1 < 6)
+        g.AddEdge({y, x, 0}, {y + 1, x, 0}, 1);
+    }
+  }
+  g.RemoveEdge({0, 0, 0}, {0, 1, 0});
+  g.RemoveEdge({2, 2, 0}, {2, 3, 0});
+  g.ChangeTileWeight({1, 0, 0}, {1, 1, 0}, 3);
+  g.AddEdge({0, 0, 0}, {0, 1, 0}, 2);
+
+  int32_t path_size;
+  int len;
+  for (int direction = 0; direction < 4; direction++)
+  {
+    g.FindPathAStar({0, 0, 0}, {5, 5, 0}, path, path_size, len, direction);
+    if (path_size == 0 || len < 0)
+    {
+      std::printf("no path found with direction %d\n", direction);
+      failures++;
+    }
+  }
+
+  if (num_allocations != allocations_before)
+  {
+    std::printf("%zu heap allocations after construction\n", num_allocations - allocations_before);
+    failures++;
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,180 @@
+// Checks mutation_queue: the change set recorded for each mutation type, and a producer
+// thread pushing while the consumer drains, against the same mutations applied directly.
+
+#include "graph.h"
+#include "mutation_queue.h"
+
+#include <cstdio>
+#include <thread>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                \
+  do                                                                    \
+  {                                                                     \
+    if (!(condition))                                                   \
+    {                                                                   \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                       \
+    }                                                                   \
+  } while (0)
+
+typedef std::pair<int32_t, int32_t> Edge;
+
+// The Run function pushes one mutation, drains it and returns what it changed.
+template <uint32_t Capacity>
+ChangeSet Run(graph &g, mutation_queue<Capacity> &queue, const GraphMutation &mutation)
+{
+  ChangeSet changes;
+  CHECK(queue.Push(mutation));
+  CHECK(queue.Drain(g) == 1);
+  queue.TakeChanges(changes);
+  CHECK(changes.empty() || changes.version == g.Version());
+  CHECK(g.CheckInvariants());
+  return changes;
+}
+
+// The MakeMutation function returns the i-th mutation of the threaded test: vertices and edges along
+// a line, weight changes and removals of edges behind them, and observations next to them.
+GraphMutation MakeMutation(int32_t i)
+{
+  int32_t x = i / 5;
+  switch (i % 5)
+  {
+  case 0:
+    return {MutationType::AddVertex, {0, x, 0}, {0, 0, 0}, 0, 0};
+  case 1:
+    return {MutationType::AddEdge, {0, x - 1, 0}, {0, x, 0}, (uint16_t)(1 + x % 7), 0};
+  case 2:
+    return {MutationType::ChangeWeight, {0, x - 1, 0}, {0, x, 0}, (uint16_t)(1 + x % 5), 0};
+  case 3:
+    return {MutationType::Observe, {1, x, 0}, {0, 0, 0}, (uint16_t)(1 + x % 3), (uint8_t)(x % 16)};
+  default:
+    return x % 3 == 0 ? GraphMutation{MutationType::RemoveEdge, {0, x - 2, 0}, {0, x - 1, 0}, 0, 0}
+                      : GraphMutation{MutationType::RemoveVertex, {1, x - 3, 0}, {0, 0, 0}, 0, 0};
+  }
+}
+
+int main()
+{
+  // One mutation of each type. Tile (0, 0, 0) is a vertex away from the others, so it must never
+  // appear as changed through the unused to field of a mutation.
+  {
+    graph g;
+    mutation_queue<8> queue;
+    g.AddVertex({0, 0, 0});
+    for (int32_t x = 0; x < 3; x++)
+    {
+      g.AddVertex({5, x, 0});
+    }
+    g.AddEdge({5, 0, 0}, {5, 1, 0}, 1);
+    g.AddEdge({5, 1, 0}, {5, 2, 0}, 1);
+    int32_t a = g.GetNode(Tile{0, 0, 0});
+    int32_t b = g.GetNode(Tile{5, 0, 0});
+    int32_t c = g.GetNode(Tile{5, 1, 0});
+    int32_t d = g.GetNode(Tile{5, 2, 0});
+
+    ChangeSet changes = Run(g, queue, {MutationType::AddVertex, {5, 3, 0}, {0, 0, 0}, 0, 0});
+    int32_t e = g.GetNode(Tile{5, 3, 0});
+    CHECK(changes.added_vertices == std::vector<int32_t>{e});
+    CHECK(changes.vertices.empty() && changes.added_edges.empty() && changes.edges.empty());
+
+    changes = Run(g, queue, {MutationType::AddEdge, {5, 2, 0}, {5, 3, 0}, 3, 0});
+    CHECK(changes.added_edges == std::vector<Edge>{Edge(d, e)});
+    CHECK(changes.vertices == (std::vector<int32_t>{d, e}));
+
+    changes = Run(g, queue, {MutationType::ChangeWeight, {5, 1, 0}, {5, 2, 0}, 7, 0});
+    CHECK(changes.edges.size() == 2);
+    for (const EdgeChange &change : changes.edges)
+    {
+      CHECK(change.old_weight == 1 && change.new_weight == 7);
+    }
+    CHECK(changes.vertices == (std::vector<int32_t>{c, d}));
+
+    changes = Run(g, queue, {MutationType::RemoveEdge, {5, 3, 0}, {5, 2, 0}, 0, 0});
+    CHECK(changes.removed_edges == std::vector<Edge>{Edge(d, e)});
+    CHECK(changes.vertices == (std::vector<int32_t>{d, e}));
+
+    changes = Run(g, queue, {MutationType::RemoveVertex, {5, 1, 0}, {0, 0, 0}, 0, 0});
+    CHECK(changes.removed_vertices == std::vector<int32_t>{c});
+    CHECK(changes.removed_edges.size() == 2);
+    CHECK(changes.vertices == (std::vector<int32_t>{b, c, d}));
+
+    changes = Run(g, queue, {MutationType::Observe, {5, 4, 0}, {0, 0, 0}, 2, 0});
+    CHECK(changes.added_vertices.size() == 1);
+    CHECK(changes.added_edges.size() == 1);
+    for (int32_t vertex : changes.vertices)
+    {
+      CHECK(vertex != a);
+    }
+
+    // A mutation that changes nothing records nothing.
+    changes = Run(g, queue, {MutationType::RemoveVertex, {9, 9, 0}, {0, 0, 0}, 0, 0});
+    CHECK(changes.empty() && changes.vertices.empty());
+  }
+
+  // A producer thread pushes while the consumer drains a few mutations at a time.
+  {
+    const int32_t num_mutations = 10000;
+    graph g, expected;
+    mutation_queue<64> queue;
+    std::thread producer([&]()
+                         {
+                           for (int32_t i = 0; i < num_mutations; i++)
+                           {
+                             while (!queue.Push(MakeMutation(i)))
+                               std::this_thread::yield();
+                           } });
+    ChangeSet changes;
+    int32_t drained = 0;
+    size_t num_added = 0, num_removed = 0;
+    while (drained < num_mutations)
+    {
+      drained += queue.Drain(g, 1 + drained % 13);
+      queue.TakeChanges(changes);
+      CHECK(changes.empty() || changes.version == g.Version());
+      num_added += changes.added_vertices.size();
+      num_removed += changes.removed_vertices.size();
+    }
+    producer.join();
+    CHECK(queue.Size() == 0);
+
+    ChangeSet ignored;
+    for (int32_t i = 0; i < num_mutations; i++)
+    {
+      GraphMutation mutation = MakeMutation(i);
+      switch (mutation.type)
+      {
+      case MutationType::AddVertex:
+        expected.AddVertex(mutation.from);
+        break;
+      case MutationType::AddEdge:
+        expected.AddEdge(mutation.from, mutation.to, mutation.weight);
+        break;
+      case MutationType::ChangeWeight:
+        expected.ChangeTileWeight(mutation.from, mutation.to, mutation.weight);
+        break;
+      case MutationType::Observe:
+        expected.ApplyObservations({{mutation.from, mutation.walls, mutation.weight}}, ignored);
+        break;
+      case MutationType::RemoveEdge:
+        expected.RemoveEdge(mutation.from, mutation.to);
+        break;
+      default:
+        expected.RemoveVertex(mutation.from);
+        break;
+      }
+    }
+
+    GraphStatistics stats, expected_stats;
+    g.GetStatistics(stats);
+    expected.GetStatistics(expected_stats);
+    CHECK(g.CheckInvariants());
+    CHECK(stats.num_vertices == expected_stats.num_vertices);
+    CHECK(stats.num_edges == expected_stats.num_edges);
+    CHECK(stats.total_weight == expected_stats.total_weight);
+    CHECK((int32_t)(num_added - num_removed) == stats.num_vertices);
+  }
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+// Checks graph::ApplyObservations on tiles at the edge of the key range.
+//
+// An observation of a tile outside Tile::InKeyRange() cannot become a vertex. It used to be
+// kept by the coalescing step, so its sides were processed with vertex index -1 whenever an
+// in-range neighbour existed, writing before the start of the adjacency array.
+
+#include "graph.h"
+
+#include <cstdio>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                \
+  do                                                                    \
+  {                                                                     \
+    if (!(condition))                                                   \
+    {                                                                   \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                       \
+    }                                                                   \
+  } while (0)
+
+int main()
+{
+  const int32_t last = kTileKeyAxisBias - 1;
+
+  // An in-range vertex next to an out-of-range observation, alone and together with an in-range one.
+  graph g;
+  CHECK(g.AddVertex({last, 0, 0}));
+  CHECK(g.AddVertex({last - 1, 0, 0}));
+  uint64_t version = g.Version();
+  ChangeSet changes;
+  CHECK(g.ApplyObservations({{{last + 1, 0, 0}, 0, 1}}, changes) == 0);
+  CHECK(changes.empty());
+  CHECK(g.Version() == version);
+  CHECK(g.NumVertices() == 2);
+  CHECK(g.CheckInvariants());
+
+  int applied = g.ApplyObservations({{{last + 1, 0, 0}, 0, 1}, {{last, 0, 0}, 0, 2}, {{0, -kTileKeyAxisBias - 1, 0}, 0, 1}}, changes);
+  CHECK(applied == 1);
+  CHECK(changes.added_edges.size() == 1);
+  CHECK(g.AreAdjacent({last, 0, 0}, {last - 1, 0, 0}));
+  CHECK(g.NumVertices() == 2);
+  CHECK(g.NumEdges() == 1);
+  CHECK(g.CheckInvariants());
+
+  // The lowest in-range coordinate is still accepted.
+  applied = g.ApplyObservations({{{-kTileKeyAxisBias, 0, 0}, 0, 1}}, changes);
+  CHECK(applied == 1);
+  CHECK(changes.added_vertices.size() == 1);
+  CHECK(g.CheckInvariants());
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+// Checks that multi_agent_planner::Plan returns plans without collisions.
+//
+// Every agent is followed step by step: along its path, then parked on its last tile, or parked
+// on its start tile from time 0 when it has no plan. No two agents may share a tile at the same
+// step or swap tiles between two steps.
+
+#include "graph.h"
+#include "multi_agent_planner.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                                           \
+  do                                                                    \
+  {                                                                     \
+    if (!(condition))                                                   \
+    {                                                                   \
+      if (failures < 20)                                                \
+      {                                                                 \
+        std::printf("%s:%d: CHECK(%s) failed: ", __FILE__, __LINE__, #condition); \
+        std::printf(__VA_ARGS__);                                       \
+        std::printf("\n");                                              \
+      }                                                                 \
+      failures++;                                                       \
+    }                                                                   \
+  } while (0)
+
+// The TileAt function returns the tile an agent is on at a time step.
+Tile TileAt(const AgentRequest &agent, const AgentPlan &plan, size_t time)
+{
+  if (plan.path.empty())
+    return agent.start;
+  return plan.path[std::min(time, plan.path.size() - 1)];
+}
+
+// The CheckPlans function checks every plan against the graph and the plans against each other.
+void CheckPlans(graph &g, const std::vector<AgentRequest> &agents, const std::vector<AgentPlan> &plans, int found)
+{
+  size_t horizon = 1;
+  int num_plans = 0;
+  for (size_t i = 0; i < agents.size(); i++)
+  {
+    const std::vector<Tile> &path = plans[i].path;
+    horizon = std::max(horizon, path.size());
+    CHECK(path.empty() == (plans[i].cost == -1), "agent %zu: cost %d with %zu tiles", i, plans[i].cost, path.size());
+    if (path.empty())
+      continue;
+    num_plans++;
+    CHECK(path.front() == agents[i].start && path.back() == agents[i].goal, "agent %zu: path does not join start and goal", i);
+    for (size_t t = 1; t < path.size(); t++)
+    {
+      CHECK(path[t] == path[t - 1] || g.AreAdjacent(path[t - 1], path[t]), "agent %zu: step %zu is not a move", i, t);
+    }
+  }
+  CHECK(num_plans == found, "%d plans, %d reported", num_plans, found);
+
+  for (size_t t = 0; t <= horizon; t++)
+  {
+    for (size_t i = 0; i < agents.size(); i++)
+    {
+      for (size_t j = i + 1; j < agents.size(); j++)
+      {
+        Tile a = TileAt(agents[i], plans[i], t), b = TileAt(agents[j], plans[j], t);
+        CHECK(!(a == b), "agents %zu and %zu meet at step %zu", i, j, t);
+        if (t > 0)
+        {
+          Tile previous_a = TileAt(agents[i], plans[i], t - 1), previous_b = TileAt(agents[j], plans[j], t - 1);
+          CHECK(!(a == previous_b && b == previous_a), "agents %zu and %zu swap at step %zu", i, j, t);
+        }
+      }
+    }
+  }
+}
+
+int main()
+{
+  // A line of 4 tiles: agent 0 crosses it while agent 1 stays on tile 1, so agent 0 cannot pass.
+  {
+    graph g;
+    for (int32_t x = 0; x < 4; x++)
+    {
+      g.AddVertex({0, x, 0});
+      if (x > 0)
+        g.AddEdge({0, x - 1, 0}, {0, x, 0}, 1);
+    }
+    multi_agent_planner planner(g);
+    std::vector<AgentRequest> agents = {{{0, 0, 0}, {0, 3, 0}, 1}, {{0, 1, 0}, {0, 1, 0}, 1}};
+    std::vector<AgentPlan> plans;
+    int found = planner.Plan(agents, plans);
+    CHECK(found == 1 && plans[0].path.empty() && plans[1].path.size() == 1, "line: %d plans", found);
+    CheckPlans(g, agents, plans, found);
+  }
+
+  // Random agents on grids with holes.
+  std::mt19937 random(1);
+  int num_plans = 0, num_agents = 0;
+  for (int round = 0; round < 60; round++)
+  {
+    graph g;
+    int32_t side = 3 + random() % 5;
+    std::vector<Tile> tiles;
+    for (int32_t y = 0; y < side; y++)
+    {
+      for (int32_t x = 0; x < side; x++)
+      {
+        if (random() % 5 == 0)
+          continue;
+        g.AddVertex({y, x, 0});
+        tiles.push_back({y, x, 0});
+        g.AddEdge({y - 1, x, 0}, {y, x, 0}, 1 + random() % 3);
+        g.AddEdge({y, x - 1, 0}, {y, x, 0}, 1 + random() % 3);
+      }
+    }
+    std::vector<Tile> starts = tiles, goals = tiles;
+    std::shuffle(starts.begin(), starts.end(), random);
+    std::shuffle(goals.begin(), goals.end(), random);
+    std::vector<AgentRequest> agents;
+    for (size_t i = 0; i < tiles.size() / 3; i++)
+    {
+      agents.push_back({starts[i], goals[i], (int)(random() % 4)});
+    }
+
+    multi_agent_planner planner(g);
+    std::vector<AgentPlan> plans;
+    int found = planner.Plan(agents, plans, 1 + round % 3);
+    CheckPlans(g, agents, plans, found);
+    num_plans += found;
+    num_agents += agents.size();
+  }
+
+  std::printf("%d of %d agents planned, %d failures\n", num_plans, num_agents, failures);
+  return failures == 0 ? 0 : 1;
+}
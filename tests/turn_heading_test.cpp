@@ -0,0 +1,66 @@
+// Checks that turning around along x leaves the robot facing the direction of the move.
+//
+// The Distance functor used to charge the turn-around but keep the old heading when moving
+// against +x or -x, so every later step along the same line was charged a turn-around again,
+// and a path could bounce back and forth to end with a cheaper heading. CostPolicy::StepCost
+// always returns the direction of a lateral move; this test pins that behaviour down for
+// FindPathAStar, the corridor layer and the reference search.
+
+#include "graph.h"
+#include "corridor_graph.h"
+
+#include <cstdio>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                \
+  do                                                                    \
+  {                                                                     \
+    if (!(condition))                                                   \
+    {                                                                   \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                       \
+    }                                                                   \
+  } while (0)
+
+int main()
+{
+  CostPolicy policy;
+  const int directions[4][2] = {{1, 0}, {0, 1}, {-1, 0}, {0, -1}}; // (dy, dx) of 0 (+y), 1 (+x), 2 (-y), 3 (-x).
+
+  // Turning around, in every direction, faces the robot along the move.
+  for (int facing = 0; facing < 4; facing++)
+  {
+    int back = (facing + 2) % 4;
+    int new_direction = -1;
+    int32_t cost = policy.StepCost({0, 0, 0}, facing, {directions[back][0], directions[back][1], 0}, 1, new_direction);
+    CHECK(new_direction == back);
+    CHECK(cost == policy.move + policy.weight_scale + policy.turn_around);
+  }
+
+  // A straight corridor along x, entered facing +x from its east end: the robot turns around
+  // once and then drives straight. The old rule kept heading +x and charged the turn-around
+  // on each of the four steps.
+  graph g;
+  for (int32_t x = 0; x < 5; x++)
+  {
+    g.AddVertex({0, x, 0});
+    if (x > 0)
+      g.AddEdge({0, x - 1, 0}, {0, x, 0}, 1);
+  }
+  const int expected = policy.turn_around + 4 * (policy.move + policy.weight_scale);
+  const int old_rule = 4 * policy.turn_around + 4 * (policy.move + policy.weight_scale);
+  CHECK(expected < old_rule);
+
+  std::vector<Tile> path;
+  int len;
+  g.FindPathReference({0, 4, 0}, {0, 0, 0}, path, len, 1);
+  CHECK(len == expected);
+  g.FindPathAStar({0, 4, 0}, {0, 0, 0}, path, len, 1);
+  CHECK(len == expected);
+  corridor_graph corridors(g);
+  corridors.FindPath({0, 4, 0}, {0, 0, 0}, path, len, 1);
+  CHECK(len == expected);
+
+  return failures == 0 ? 0 : 1;
+}